@@ -0,0 +1,22 @@
+﻿namespace Ario.API.Models.Objects
+{
+    /// <summary>
+    /// Outcome of one item in a batch request. Index is the position of the
+    /// item in the request, Status the HTTP status the single item endpoint
+    /// would have returned for it. A batch is written in one transaction, so
+    /// when one row fails none is written and every such item is a 409.
+    /// </summary>
+    public class BatchResult<TKey>
+    {
+        public int Index { get; set; }
+        public TKey Key { get; set; }
+        public int Status { get; set; }
+
+        public BatchResult(int index, TKey key, int status)
+        {
+            Index = index;
+            Key = key;
+            Status = status;
+        }
+    }
+}
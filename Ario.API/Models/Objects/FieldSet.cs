@@ -0,0 +1,218 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Linq.Expressions;
+using System.Text;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Mvc;
+using Microsoft.Extensions.DependencyInjection;
+using Microsoft.Extensions.Options;
+using Newtonsoft.Json;
+using Newtonsoft.Json.Serialization;
+
+namespace Ario.API.Models.Objects
+{
+    /// <summary>
+    /// The display columns of a table that a ?fields= request may name. The
+    /// generator writes the list, so a request can only ask for real columns.
+    /// </summary>
+    public class FieldSet<TSource, TDisplay>
+    {
+        /// <summary>
+        /// Column sets past this many share the projection of every column, so
+        /// neither this cache nor EF's query cache grows with what clients send.
+        /// </summary>
+        public const int MaxSelections = 64;
+
+        private readonly string[] _fields;
+        private readonly string _key;
+        private readonly FieldSelection<TSource, TDisplay> _all;
+        private readonly ConcurrentDictionary<string, FieldSelection<TSource, TDisplay>> _selections =
+            new ConcurrentDictionary<string, FieldSelection<TSource, TDisplay>>();
+
+        public FieldSet(string key, params string[] fields)
+        {
+            _fields = fields;
+            _key = fields.Contains(key) ? key : null;
+            _all = new FieldSelection<TSource, TDisplay>(fields, _key, true);
+        }
+
+        /// <summary>
+        /// Reads a comma separated list of column names, in any case and order.
+        /// </summary>
+        /// <returns>False if a name is not one of the columns.</returns>
+        /// <param name="fields">The ?fields= value; empty selects every column.</param>
+        /// <param name="selection">The selection, shared by every request that names the same columns
+        /// while fewer than MaxSelections sets are cached.</param>
+        public bool TryParse(string fields, out FieldSelection<TSource, TDisplay> selection)
+        {
+            selection = _all;
+            if (string.IsNullOrWhiteSpace(fields))
+            {
+                return true;
+            }
+
+            bool[] wanted = new bool[_fields.Length];
+            foreach (string part in fields.Split(new[] { ',' }, StringSplitOptions.RemoveEmptyEntries))
+            {
+                string name = part.Trim();
+                int index = Array.FindIndex(_fields, f => string.Equals(f, name, StringComparison.OrdinalIgnoreCase));
+                if (index < 0)
+                {
+                    selection = null;
+                    return false;
+                }
+                wanted[index] = true;
+            }
+
+            // Named in column order without repeats, so each set of columns has one key
+            string[] names = _fields.Where((f, i) => wanted[i]).ToArray();
+            if (names.Length == 0 || names.Length == _fields.Length)
+            {
+                return true;
+            }
+            string joined = string.Join(",", names);
+            if (!_selections.TryGetValue(joined, out selection))
+            {
+                if (_selections.Count < MaxSelections)
+                {
+                    selection = _selections.GetOrAdd(joined, k => new FieldSelection<TSource, TDisplay>(names, _key, false));
+                }
+                else
+                {
+                    // SQL reads every column, but the response still holds only the named ones
+                    selection = new FieldSelection<TSource, TDisplay>(names, _all);
+                }
+            }
+            return true;
+        }
+    }
+
+    /// <summary>
+    /// The columns one request asked for. Projection reads only those, plus
+    /// the key that paging needs, and the results write only those, so the
+    /// columns left out cost neither SQL reads nor response bytes.
+    /// </summary>
+    public class FieldSelection<TSource, TDisplay>
+    {
+        private readonly HashSet<string> _names;
+        private readonly bool _all;
+        private readonly ConcurrentDictionary<IContractResolver, IContractResolver> _resolvers =
+            new ConcurrentDictionary<IContractResolver, IContractResolver>();
+
+        public Expression<Func<TSource, TDisplay>> Projection { get; }
+
+        internal FieldSelection(string[] names, string key, bool all)
+        {
+            _names = new HashSet<string>(names);
+            _all = all;
+
+            IEnumerable<string> read = (key == null || _names.Contains(key)) ? names : names.Concat(new[] { key });
+            ParameterExpression row = Expression.Parameter(typeof(TSource), "t");
+            Projection = Expression.Lambda<Func<TSource, TDisplay>>(
+                Expression.MemberInit(Expression.New(typeof(TDisplay)),
+                    read.Select(name => Expression.Bind(typeof(TDisplay).GetProperty(name), Expression.Property(row, name)))),
+                row);
+        }
+
+        internal FieldSelection(string[] names, FieldSelection<TSource, TDisplay> reads)
+        {
+            _names = new HashSet<string>(names);
+            _all = false;
+            Projection = reads.Projection;
+        }
+
+        /// <summary>
+        /// Writes a list or page of display objects with only the selected columns.
+        /// </summary>
+        /// <returns>The result.</returns>
+        /// <param name="value">The value to write.</param>
+        public IActionResult Result(object value)
+        {
+            if (_all)
+            {
+                return new ObjectResult(value);
+            }
+            return new SelectionResult(value, this);
+        }
+
+        /// <summary>
+        /// Streams the rows of a query with only the selected columns.
+        /// </summary>
+        /// <returns>The result.</returns>
+        /// <param name="rows">The query to stream.</param>
+        public IActionResult Stream(IQueryable<TDisplay> rows)
+        {
+            if (_all)
+            {
+                return new JsonStreamResult<TDisplay>(rows);
+            }
+            return new JsonStreamResult<TDisplay>(rows, CreateSerializer);
+        }
+
+        /// <summary>
+        /// Builds a serializer from the app's settings that leaves the unselected
+        /// columns of TDisplay out. The resolver keeps the app's naming strategy
+        /// and is cached, so its contracts are only built once.
+        /// </summary>
+        /// <returns>The serializer.</returns>
+        /// <param name="settings">The MVC JSON settings.</param>
+        public JsonSerializer CreateSerializer(JsonSerializerSettings settings)
+        {
+            var serializer = JsonSerializer.Create(settings);
+            serializer.ContractResolver = _resolvers.GetOrAdd(serializer.ContractResolver,
+                inner => new SelectionContractResolver(_names, inner as DefaultContractResolver));
+            return serializer;
+        }
+
+        private class SelectionContractResolver : DefaultContractResolver
+        {
+            private readonly HashSet<string> _names;
+
+            public SelectionContractResolver(HashSet<string> names, DefaultContractResolver inner)
+            {
+                _names = names;
+                NamingStrategy = inner?.NamingStrategy;
+            }
+
+            protected override IList<JsonProperty> CreateProperties(Type type, MemberSerialization memberSerialization)
+            {
+                IList<JsonProperty> properties = base.CreateProperties(type, memberSerialization);
+                if (type != typeof(TDisplay))
+                {
+                    return properties;
+                }
+                return properties.Where(p => _names.Contains(p.UnderlyingName)).ToList();
+            }
+        }
+
+        private class SelectionResult : IActionResult
+        {
+            private readonly object _value;
+            private readonly FieldSelection<TSource, TDisplay> _selection;
+
+            public SelectionResult(object value, FieldSelection<TSource, TDisplay> selection)
+            {
+                _value = value;
+                _selection = selection;
+            }
+
+            public async Task ExecuteResultAsync(ActionContext context)
+            {
+                var http = context.HttpContext;
+                var settings = http.RequestServices.GetRequiredService<IOptions<MvcJsonOptions>>().Value.SerializerSettings;
+                var serializer = _selection.CreateSerializer(settings);
+
+                http.Response.ContentType = "application/json; charset=utf-8";
+                using (var writer = new StreamWriter(http.Response.Body, new UTF8Encoding(false), 16384, true))
+                using (var json = new JsonTextWriter(writer))
+                {
+                    serializer.Serialize(json, _value);
+                    await writer.FlushAsync();
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,87 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Mvc;
+using Microsoft.Extensions.DependencyInjection;
+using Microsoft.Extensions.Options;
+using Newtonsoft.Json;
+
+namespace Ario.API.Models.Objects
+{
+    /// <summary>
+    /// Writes the rows of a query to the response as a JSON array while they
+    /// are read, so memory per request stays flat and the first rows go out
+    /// before the last ones are fetched. EF queries are read asynchronously
+    /// and stop when the client disconnects.
+    /// </summary>
+    public class JsonStreamResult<TItem> : IActionResult
+    {
+        private const int FlushEvery = 100;
+
+        private readonly IQueryable<TItem> _rows;
+        private readonly Func<JsonSerializerSettings, JsonSerializer> _createSerializer;
+
+        public JsonStreamResult(IQueryable<TItem> rows)
+            : this(rows, JsonSerializer.Create)
+        {
+        }
+
+        /// <summary>
+        /// Streams the rows with a serializer built from the app's settings,
+        /// for responses that write rows differently, such as ?fields=.
+        /// </summary>
+        /// <param name="rows">The query to stream.</param>
+        /// <param name="createSerializer">Builds the serializer from the MVC JSON settings.</param>
+        public JsonStreamResult(IQueryable<TItem> rows, Func<JsonSerializerSettings, JsonSerializer> createSerializer)
+        {
+            _rows = rows;
+            _createSerializer = createSerializer;
+        }
+
+        public async Task ExecuteResultAsync(ActionContext context)
+        {
+            var http = context.HttpContext;
+            var settings = http.RequestServices.GetRequiredService<IOptions<MvcJsonOptions>>().Value.SerializerSettings;
+            var serializer = _createSerializer(settings);
+
+            http.Response.ContentType = "application/json; charset=utf-8";
+            using (var writer = new StreamWriter(http.Response.Body, new UTF8Encoding(false), 16384, true))
+            using (var json = new JsonTextWriter(writer))
+            {
+                int count = 0;
+                json.WriteStartArray();
+                var asyncRows = _rows as IAsyncEnumerable<TItem>;
+                if (asyncRows != null)
+                {
+                    using (var rows = asyncRows.GetEnumerator())
+                    {
+                        while (await rows.MoveNext(http.RequestAborted))
+                        {
+                            serializer.Serialize(json, rows.Current);
+                            if (++count % FlushEvery == 0)
+                            {
+                                await writer.FlushAsync();
+                            }
+                        }
+                    }
+                }
+                else
+                {
+                    foreach (TItem row in _rows)
+                    {
+                        serializer.Serialize(json, row);
+                        if (++count % FlushEvery == 0)
+                        {
+                            await writer.FlushAsync();
+                        }
+                    }
+                }
+                json.WriteEndArray();
+                await writer.FlushAsync();
+            }
+        }
+    }
+}
@@ -0,0 +1,35 @@
+﻿using System;
+using System.Collections.Generic;
+
+namespace Ario.API.Models.Objects
+{
+    /// <summary>
+    /// One page of a keyset paginated list. Next holds the key to pass as
+    /// "after" to fetch the following page, or null on the last page.
+    /// </summary>
+    public class Page<TItem, TKey>
+    {
+        public List<TItem> Items { get; set; }
+        public TKey Next { get; set; }
+
+        /// <summary>
+        /// Builds a page from rows read in key order with one row more than
+        /// the page holds; the extra row only shows that another page follows.
+        /// </summary>
+        /// <returns>The page.</returns>
+        /// <param name="rows">Up to limit + 1 rows in key order.</param>
+        /// <param name="limit">Number of rows in a full page.</param>
+        /// <param name="key">Reads the key of a row.</param>
+        public static Page<TItem, TKey> FromRows(List<TItem> rows, int limit, Func<TItem, TKey> key)
+        {
+            Page<TItem, TKey> page = new Page<TItem, TKey>();
+            if (rows.Count > limit)
+            {
+                rows.RemoveRange(limit, rows.Count - limit);
+                page.Next = key(rows[limit - 1]);
+            }
+            page.Items = rows;
+            return page;
+        }
+    }
+}
@@ -0,0 +1,251 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Ario.API.Models.Objects
+{
+    /// <summary>
+    /// Counters for the generated repositories and contexts, kept per table
+    /// and method for the life of the process. Every update is an Interlocked
+    /// add, so recording a call never takes a lock.
+    /// </summary>
+    public static class RepositoryMetrics
+    {
+        private static readonly ConcurrentDictionary<string, MethodMetrics> _methods =
+            new ConcurrentDictionary<string, MethodMetrics>();
+        private static readonly ConcurrentDictionary<string, SaveMetrics> _saves =
+            new ConcurrentDictionary<string, SaveMetrics>();
+
+        /// <summary>
+        /// The counters of one repository method, created on first use.
+        /// </summary>
+        /// <returns>The counters.</returns>
+        /// <param name="table">The API name of the table.</param>
+        /// <param name="method">The method, without any Async suffix.</param>
+        public static MethodMetrics Method(string table, string method)
+        {
+            return _methods.GetOrAdd(table + "." + method, k => new MethodMetrics(table, method));
+        }
+
+        /// <summary>
+        /// Counts one SaveChanges call and the rows it wrote.
+        /// </summary>
+        /// <param name="context">The context class that saved.</param>
+        /// <param name="rows">The rows SaveChanges reported as written.</param>
+        public static void Saved(string context, int rows)
+        {
+            SaveMetrics save = _saves.GetOrAdd(context, k => new SaveMetrics());
+            Interlocked.Increment(ref save.Calls);
+            Interlocked.Add(ref save.Rows, rows);
+        }
+
+        /// <summary>
+        /// Writes every counter in the Prometheus text format.
+        /// </summary>
+        /// <param name="writer">Where the text goes.</param>
+        public static void WriteTo(TextWriter writer)
+        {
+            var methods = _methods.Values.OrderBy(m => m.Table).ThenBy(m => m.Method).ToList();
+            var saves = _saves.OrderBy(s => s.Key).ToList();
+
+            writer.Write("# HELP ario_repository_duration_seconds Time spent in each generated repository method.\n");
+            writer.Write("# TYPE ario_repository_duration_seconds histogram\n");
+            foreach (MethodMetrics method in methods)
+            {
+                method.WriteHistogram(writer);
+            }
+
+            writer.Write("# HELP ario_repository_failures_total Calls that ended in an exception.\n");
+            writer.Write("# TYPE ario_repository_failures_total counter\n");
+            foreach (MethodMetrics method in methods)
+            {
+                writer.Write("ario_repository_failures_total{" + method.Labels + "} " + Interlocked.Read(ref method.Failures) + "\n");
+            }
+
+            writer.Write("# HELP ario_repository_rows_total Rows returned by read methods; streamed lists are not counted.\n");
+            writer.Write("# TYPE ario_repository_rows_total counter\n");
+            foreach (MethodMetrics method in methods)
+            {
+                writer.Write("ario_repository_rows_total{" + method.Labels + "} " + Interlocked.Read(ref method.Rows) + "\n");
+            }
+
+            writer.Write("# HELP ario_savechanges_total SaveChanges calls per context.\n");
+            writer.Write("# TYPE ario_savechanges_total counter\n");
+            foreach (var save in saves)
+            {
+                writer.Write("ario_savechanges_total{context=\"" + save.Key + "\"} " + Interlocked.Read(ref save.Value.Calls) + "\n");
+            }
+
+            writer.Write("# HELP ario_savechanges_rows_total Rows written by SaveChanges per context.\n");
+            writer.Write("# TYPE ario_savechanges_rows_total counter\n");
+            foreach (var save in saves)
+            {
+                writer.Write("ario_savechanges_rows_total{context=\"" + save.Key + "\"} " + Interlocked.Read(ref save.Value.Rows) + "\n");
+            }
+        }
+
+        private class SaveMetrics
+        {
+            public long Calls;
+            public long Rows;
+        }
+    }
+
+    /// <summary>
+    /// Call count, latency histogram, failures and rows returned for one
+    /// repository method. The Measure calls wrap the real call and record
+    /// it whether it returns or throws.
+    /// </summary>
+    public class MethodMetrics
+    {
+        /// <summary>
+        /// Upper bounds of the latency buckets, in seconds.
+        /// </summary>
+        public static readonly double[] Buckets = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+
+        public string Table { get; }
+        public string Method { get; }
+
+        internal readonly string Labels;
+        internal long Failures;
+        internal long Rows;
+
+        private readonly long[] _buckets = new long[Buckets.Length + 1];
+        private long _ticks;
+
+        public MethodMetrics(string table, string method)
+        {
+            Table = table;
+            Method = method;
+            Labels = "table=\"" + table + "\",method=\"" + method + "\"";
+        }
+
+        public void Measure(Action call)
+        {
+            long start = Stopwatch.GetTimestamp();
+            try
+            {
+                call();
+            }
+            catch
+            {
+                Observe(start, true);
+                throw;
+            }
+            Observe(start, false);
+        }
+
+        public T Measure<T>(Func<T> call)
+        {
+            return Measure(call, null);
+        }
+
+        /// <summary>
+        /// Times a call and adds the rows its result holds.
+        /// </summary>
+        /// <returns>What the call returned.</returns>
+        /// <param name="call">The repository call.</param>
+        /// <param name="rows">Counts the rows in the result; null counts none.</param>
+        public T Measure<T>(Func<T> call, Func<T, int> rows)
+        {
+            long start = Stopwatch.GetTimestamp();
+            T result;
+            try
+            {
+                result = call();
+            }
+            catch
+            {
+                Observe(start, true);
+                throw;
+            }
+            Observe(start, false);
+            if (rows != null)
+            {
+                Interlocked.Add(ref Rows, rows(result));
+            }
+            return result;
+        }
+
+        public async Task MeasureAsync(Func<Task> call)
+        {
+            long start = Stopwatch.GetTimestamp();
+            try
+            {
+                await call();
+            }
+            catch
+            {
+                Observe(start, true);
+                throw;
+            }
+            Observe(start, false);
+        }
+
+        public Task<T> MeasureAsync<T>(Func<Task<T>> call)
+        {
+            return MeasureAsync(call, null);
+        }
+
+        public async Task<T> MeasureAsync<T>(Func<Task<T>> call, Func<T, int> rows)
+        {
+            long start = Stopwatch.GetTimestamp();
+            T result;
+            try
+            {
+                result = await call();
+            }
+            catch
+            {
+                Observe(start, true);
+                throw;
+            }
+            Observe(start, false);
+            if (rows != null)
+            {
+                Interlocked.Add(ref Rows, rows(result));
+            }
+            return result;
+        }
+
+        private void Observe(long start, bool failed)
+        {
+            long elapsed = Stopwatch.GetTimestamp() - start;
+            double seconds = (double) elapsed / Stopwatch.Frequency;
+            int bucket = 0;
+            while (bucket < Buckets.Length && seconds > Buckets[bucket])
+            {
+                bucket++;
+            }
+            Interlocked.Increment(ref _buckets[bucket]);
+            Interlocked.Add(ref _ticks, elapsed);
+            if (failed)
+            {
+                Interlocked.Increment(ref Failures);
+            }
+        }
+
+        internal void WriteHistogram(TextWriter writer)
+        {
+            long cumulative = 0;
+            for (int i = 0; i < Buckets.Length; i++)
+            {
+                cumulative += Interlocked.Read(ref _buckets[i]);
+                writer.Write("ario_repository_duration_seconds_bucket{" + Labels + ",le=\""
+                             + Buckets[i].ToString(CultureInfo.InvariantCulture) + "\"} " + cumulative + "\n");
+            }
+            cumulative += Interlocked.Read(ref _buckets[Buckets.Length]);
+            writer.Write("ario_repository_duration_seconds_bucket{" + Labels + ",le=\"+Inf\"} " + cumulative + "\n");
+
+            double seconds = (double) Interlocked.Read(ref _ticks) / Stopwatch.Frequency;
+            writer.Write("ario_repository_duration_seconds_sum{" + Labels + "} "
+                         + seconds.ToString(CultureInfo.InvariantCulture) + "\n");
+            writer.Write("ario_repository_duration_seconds_count{" + Labels + "} " + cumulative + "\n");
+        }
+    }
+}
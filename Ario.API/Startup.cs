@@ -72,6 +72,7 @@ namespace Ario.API
             //});
 
             services.AddMvc();
+            services.AddMemoryCache();
         }
 
         private void AddScopes(IServiceCollection services) 
@@ -0,0 +1,33 @@
+﻿using Microsoft.Data.Sqlite;
+using Microsoft.EntityFrameworkCore;
+
+namespace Ario.Bench
+{
+    /// <summary>
+    /// The in-memory SQLite database the generated contexts run against.
+    /// </summary>
+    public static class BenchDatabase
+    {
+        /// <summary>
+        /// Opens a new, empty database. It lives until the connection closes,
+        /// so every context of a run has to share this one connection.
+        /// </summary>
+        public static SqliteConnection Open()
+        {
+            var connection = new SqliteConnection("Data Source=:memory:");
+            connection.Open();
+            return connection;
+        }
+
+        /// <summary>
+        /// Options for a context on the connection. EF turns foreign keys on
+        /// only for connections it opens itself, so a table whose model points
+        /// at another one can be filled without the rows it points at.
+        /// </summary>
+        public static DbContextOptions<TContext> Options<TContext>(SqliteConnection connection)
+            where TContext : DbContext
+        {
+            return new DbContextOptionsBuilder<TContext>().UseSqlite(connection).Options;
+        }
+    }
+}
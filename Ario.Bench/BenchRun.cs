@@ -0,0 +1,95 @@
+﻿using System;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace Ario.Bench
+{
+    /// <summary>
+    /// One run of one table at one row count: how many calls each operation
+    /// gets, which rows they pick, and the timer that writes each operation
+    /// as a JSON line.
+    /// </summary>
+    public class BenchRun
+    {
+        /// <summary>Rows per AddRange call, so per SaveChanges.</summary>
+        public const int BatchSize = 1000;
+
+        private readonly string _table;
+        private readonly bool _cached;
+        private readonly int _run;
+        private readonly TextWriter _output;
+        private readonly Random _random;
+
+        public int Rows { get; }
+        public int Calls { get; }
+        public int Scans { get; }
+        public int Batches => (Rows + BatchSize - 1) / BatchSize;
+
+        public BenchRun(string table, bool cached, int rows, int run, int calls, int scans, TextWriter output)
+        {
+            _table = table;
+            _cached = cached;
+            _run = run;
+            _output = output;
+            // Seeded by the row count, so every run and every build picks the same rows
+            _random = new Random(rows);
+            Rows = rows;
+            Calls = calls;
+            Scans = scans;
+        }
+
+        /// <summary>
+        /// A row number below count.
+        /// </summary>
+        public int Pick(int count)
+        {
+            return _random.Next(count);
+        }
+
+        public void Measure(string operation, int calls, Action<int> call)
+        {
+            var start = Start();
+            var watch = Stopwatch.StartNew();
+            for (int i = 0; i < calls; i++)
+            {
+                call(i);
+            }
+            watch.Stop();
+            Write(operation, calls, watch, start);
+        }
+
+        public async Task MeasureAsync(string operation, int calls, Func<int, Task> call)
+        {
+            var start = Start();
+            var watch = Stopwatch.StartNew();
+            for (int i = 0; i < calls; i++)
+            {
+                await call(i);
+            }
+            watch.Stop();
+            Write(operation, calls, watch, start);
+        }
+
+        // Garbage the previous operation left is collected first, so it is not counted here
+        private static int[] Start()
+        {
+            GC.Collect();
+            GC.WaitForPendingFinalizers();
+            return new[] { GC.CollectionCount(0), GC.CollectionCount(1), GC.CollectionCount(2) };
+        }
+
+        private void Write(string operation, int calls, Stopwatch watch, int[] start)
+        {
+            double seconds = watch.Elapsed.TotalSeconds;
+            _output.WriteLine(string.Format(CultureInfo.InvariantCulture,
+                "{{\"table\":\"{0}\",\"cached\":{1},\"options\":\"{2}\",\"rows\":{3},\"run\":{4},\"operation\":\"{5}\"," +
+                "\"calls\":{6},\"seconds\":{7:F6},\"microsecondsPerCall\":{8:F3},\"gen0\":{9},\"gen1\":{10},\"gen2\":{11}}}",
+                _table, _cached ? "true" : "false", RepositoryBenchmarks.Options.Trim(), Rows, _run, operation,
+                calls, seconds, calls > 0 ? seconds * 1000000 / calls : 0,
+                GC.CollectionCount(0) - start[0], GC.CollectionCount(1) - start[1], GC.CollectionCount(2) - start[2]));
+            _output.Flush();
+        }
+    }
+}
@@ -0,0 +1,102 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Linq;
+
+namespace Ario.Bench
+{
+    /// <summary>
+    /// Times every generated repository against an in-memory SQLite database
+    /// and writes one JSON line per table, row count, run and operation to
+    /// stdout. Progress and errors go to stderr.
+    /// </summary>
+    public class Program
+    {
+        private const string Usage =
+            "Usage: Ario.Bench [--rows 1000,10000,100000,1000000] [--runs 3] [--calls 1000] [--scans 3] [--table Name]";
+
+        public static int Main(string[] args)
+        {
+            var rows = new List<int> { 1000, 10000, 100000, 1000000 };
+            int runs = 3;
+            int calls = 1000;
+            int scans = 3;
+            string table = null;
+
+            if (args.Length % 2 != 0)
+            {
+                Console.Error.WriteLine(Usage);
+                return 1;
+            }
+            try
+            {
+                for (int i = 0; i < args.Length; i += 2)
+                {
+                    switch (args[i])
+                    {
+                        case "--rows":
+                            rows = args[i + 1].Split(',').Select(Count).ToList();
+                            break;
+                        case "--runs":
+                            runs = Count(args[i + 1]);
+                            break;
+                        case "--calls":
+                            calls = Count(args[i + 1]);
+                            break;
+                        case "--scans":
+                            scans = Count(args[i + 1]);
+                            break;
+                        case "--table":
+                            table = args[i + 1];
+                            break;
+                        default:
+                            Console.Error.WriteLine(Usage);
+                            return 1;
+                    }
+                }
+            }
+            catch (FormatException)
+            {
+                Console.Error.WriteLine(Usage);
+                return 1;
+            }
+
+            var benchmarks = RepositoryBenchmarks.All()
+                .Where(b => table == null || string.Equals(b.Name, table, StringComparison.OrdinalIgnoreCase))
+                .ToList();
+            if (benchmarks.Count == 0)
+            {
+                Console.Error.WriteLine("No generated repository is named " + table + ".");
+                return 1;
+            }
+
+            foreach (var benchmark in benchmarks)
+            {
+                foreach (int size in rows)
+                {
+                    for (int run = 1; run <= runs; run++)
+                    {
+                        Console.Error.WriteLine("{0}: {1} rows, run {2} of {3}", benchmark.Name, size, run, runs);
+                        // A new database for every run, so no run reads rows or pages another one left behind
+                        using (var connection = BenchDatabase.Open())
+                        {
+                            benchmark.RunAsync(new BenchRun(benchmark.Name, benchmark.Cached, size, run, calls, scans, Console.Out),
+                                connection).GetAwaiter().GetResult();
+                        }
+                    }
+                }
+            }
+            return 0;
+        }
+
+        private static int Count(string text)
+        {
+            int count = int.Parse(text, NumberStyles.None, CultureInfo.InvariantCulture);
+            if (count < 1)
+            {
+                throw new FormatException();
+            }
+            return count;
+        }
+    }
+}
@@ -0,0 +1,28 @@
+﻿using System.Threading.Tasks;
+using Microsoft.Data.Sqlite;
+
+namespace Ario.Bench
+{
+    /// <summary>
+    /// The timed calls against one generated repository. The subclasses are
+    /// generated with --harness into RepositoryBenchmarks.cs, so they always
+    /// match the repositories of the same run.
+    /// </summary>
+    public abstract class TableBenchmark
+    {
+        public string Name { get; }
+        public bool Cached { get; }
+
+        protected TableBenchmark(string name, bool cached)
+        {
+            Name = name;
+            Cached = cached;
+        }
+
+        /// <summary>
+        /// Creates the table on the connection, adds run.Rows rows and times
+        /// each repository method against them.
+        /// </summary>
+        public abstract Task RunAsync(BenchRun run, SqliteConnection connection);
+    }
+}
@@ -10,473 +10,2774 @@
  Get rid of Get all tag
  */
 
+/*
+ Usage:
+   ./ContextGenerator -t Table [-a APIName] [-k Key] [-i int] [-l long] [-s string] [-d decimal]
+   ./ContextGenerator -S ArioDatabaseTransfer.sql [-S more.sql] [-j jobs]
+   [-x Table.Column] [-f Table.Column] [-e Table.Seconds]
+   [-r JoinTable.Column.Column] [-T templates] [-p pageSize] [-c Context]
+   [--async] [--stream] [--sparse] [--metrics] [--harness] [--force | --skip-existing | --check]
+   ./ContextGenerator --bench Tables.Columns[.Runs] [-j jobs] [-T templates] [other flags]
+
+ The second form reads the CREATE TABLE blocks out of one or more SQL
+ DDL files and generates the full set of files for every table found.
+
+ Every generated file is recorded in MANIFEST_FILE together with hashes
+ of the table it came from, the template that rendered it and the text
+ that was written. A rerun leaves files whose inputs have not changed
+ alone, so their mtimes stay put and the C# build sees nothing new.
+
+ The third form renders every template for a made up schema of the
+ given size and writes the files into a scratch directory, which it
+ removes afterwards. It prints one JSON line per run with the time
+ taken, the bytes written and the heap allocations made.
+
+ The C# text comes from the template files in the -T directory (see
+ templateSpecs). Each template is compiled once into a list of ops and
+ then rendered for every table, or once for the whole schema when the
+ spec says so. Templates understand:
+   {{Table}} {{Api}} {{Key}}         table, API and primary key names
+   {{KeyType}}                       C# type of the primary key
+   {{PageSize}}                      largest page a list endpoint returns (-p)
+   {{Context}}                       context class the table's repository uses
+   {{SharedContext}}                 single pooled context class (-c)
+   {{CacheSeconds}}                  how long a cached table stays in memory (-e)
+   {{Await}} {{Async}} {{Token}}     "await ", "Async" and "cancellationToken"
+                                     with --async, otherwise empty
+   {{#tables}} ... {{/tables}}       repeat once per table, in schema templates
+   {{#fields}} ... {{/fields}}       repeat once per column
+   {{#links}} ... {{/links}}         repeat once per -r relationship of the table
+   {{Join}} {{JoinKey}}              join table and its key, inside links
+   {{Near}} {{NearKey}}              join column pointing at the table and the column it matches
+   {{Far}} {{Other}}                 join column pointing at the other table, and that table
+   {{Link}} {{LinkType}}             Far without a trailing ID, and its C# type
+   {{Field}} {{Type}}                column name and C# type, inside fields
+   {{#cond}} ... {{/cond}}           keep the text only if cond holds
+   {{^cond}} ... {{/cond}}           keep the text only if cond does not hold
+ where cond is paged, async, stream, sparse or metrics (-p, --async,
+ --stream, --sparse or --metrics was given) anywhere, stringKey, linked (the table has relationships) or cached
+ (-e names the table) inside a table, or one of first, last, key, string, int, long, decimal, indexed
+ or foreignKey inside fields, where it is tested against the current
+ column. A section tag alone on its line takes the whole line with it.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
 
-#define MAX_NAME_STRING 50
-#define MAX_CALL_STRING 100
 #define MAX_FILE_STRING 150
 
-#define MAX_STRINGS 10
-#define MAX_INTS 10
-#define MAX_DECIMALS 10
+#define MAX_KEY_COLUMNS 16
+
+#define ARENA_BLOCK_SIZE 65536
+#define OUTPUT_INITIAL_SIZE 8192
+
+#define MANIFEST_FILE "Ario.API/ContextGenerator.manifest"
+
+/*
+ Bump whenever C code changes what gets written for the same templates,
+ such as fieldTypeName, the schema type mapping or a template variable,
+ so files from an older generator are regenerated.
+ */
+#define GENERATOR_VERSION "5"
+
+#define TEMPLATE_DIR "Templates"
+#define MAX_TEMPLATE_DEPTH 16
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/* Column categories understood by the templates */
+enum fieldType {
+    FIELD_INT,
+    FIELD_LONG,
+    FIELD_STRING,
+    FIELD_DECIMAL
+};
+
+/* Column parsed from a CREATE TABLE block or the command line */
+struct column {
+    char *name;
+    enum fieldType type;
+    int notNull;
+    int indexed;
+    int foreignKey;
+    char *refTable;
+    char *refColumn;
+};
+
+/* A -x or -f option, applied once the tables are known */
+struct annotation {
+    const char *target;
+    int foreignKey;
+};
+
+/*
+ Everything the templates need to know about one table. Rendering only
+ reads from the descriptor, so any number of files can render at once.
+ */
+struct link;
+
+struct tableDef {
+    char *name;
+    char *apiName;
+    char *key;
+    struct column *columns;
+    int columnCount;
+    int columnCap;
+    struct link *links;
+    int linkCount;
+    int cacheSeconds;
+    char cacheText[16];
+    uint64_t schemaHash;
+};
+
+/*
+ One side of a -r relationship: this table reaches other through the
+ join table, whose near column points here and far column points there.
+ */
+struct link {
+    const struct tableDef *join;
+    const struct column *near;
+    const struct column *far;
+    const struct column *nearKey;
+    const struct tableDef *other;
+    char *name;
+};
+
+/* What became of one generated file */
+enum fileStatus {
+    FILE_UNCHANGED,
+    FILE_WRITTEN,
+    FILE_SKIPPED,
+    FILE_STALE,
+    FILE_FAILED
+};
+
+/* What to do with a file that exists but was not written by the last run */
+enum overwriteMode {
+    OVERWRITE_GENERATED,
+    OVERWRITE_FORCE,
+    OVERWRITE_SKIP_EXISTING,
+    OVERWRITE_CHECK
+};
+
+/* One line of the manifest: a generated file and the hashes it was made from */
+struct manifestEntry {
+    char *path;
+    uint64_t schemaHash;
+    uint64_t templateHash;
+    uint64_t outputHash;
+};
+
+/* Manifest entries sorted by path */
+struct manifest {
+    struct manifestEntry *entries;
+    int count;
+    int cap;
+};
+
+/* Chunk of memory handed out by an arena */
+struct arenaBlock {
+    struct arenaBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/*
+ Bump allocator owned by one generator thread. It is reset rather than
+ freed between files, so after the first few files no more memory is
+ requested from the system.
+ */
+struct arena {
+    struct arenaBlock *head;
+    struct arenaBlock *current;
+};
+
+/* A generated file, rendered in memory before it is written out */
+struct outBuffer {
+    struct arena *arena;
+    char *data;
+    size_t length;
+    size_t cap;
+};
+
+/* Template instructions */
+enum templateOpCode {
+    OP_TEXT,
+    OP_VAR,
+    OP_TABLES,
+    OP_NEXT_TABLE,
+    OP_FIELDS,
+    OP_NEXT,
+    OP_LINKS,
+    OP_NEXT_LINK,
+    OP_IF,
+    OP_UNLESS
+};
+
+/* Values a template can substitute */
+enum templateVar {
+    VAR_TABLE,
+    VAR_API,
+    VAR_KEY,
+    VAR_KEY_TYPE,
+    VAR_PAGE_SIZE,
+    VAR_CONTEXT,
+    VAR_SHARED_CONTEXT,
+    VAR_CACHE_SECONDS,
+    VAR_AWAIT,
+    VAR_ASYNC,
+    VAR_TOKEN,
+    VAR_FIELD,
+    VAR_TYPE,
+    VAR_JOIN,
+    VAR_JOIN_KEY,
+    VAR_NEAR,
+    VAR_NEAR_KEY,
+    VAR_FAR,
+    VAR_OTHER,
+    VAR_LINK,
+    VAR_LINK_TYPE
+};
+
+/* Tests a template section can make */
+enum templateCond {
+    COND_FIRST,
+    COND_LAST,
+    COND_KEY,
+    COND_STRING,
+    COND_INT,
+    COND_LONG,
+    COND_DECIMAL,
+    COND_INDEXED,
+    COND_FOREIGN_KEY,
+    COND_PAGED,
+    COND_STRING_KEY,
+    COND_LINKED,
+    COND_CACHED,
+    COND_ASYNC,
+    COND_STREAM,
+    COND_SPARSE,
+    COND_METRICS
+};
+
+/*
+ One compiled instruction. OP_TEXT copies a span of the template source,
+ OP_VAR appends a value, OP_TABLES/OP_NEXT_TABLE, OP_FIELDS/OP_NEXT and
+ OP_LINKS/OP_NEXT_LINK bracket the table, column and relationship loops
+ and OP_IF/OP_UNLESS skip to jump when their condition fails.
+ */
+struct templateOp {
+    enum templateOpCode code;
+    int arg;
+    int jump;
+    const char *text;
+    size_t length;
+};
+
+struct templateProgram {
+    struct templateOp *ops;
+    int count;
+    int cap;
+};
+
+/* A template file mapped into memory with its compiled output path and body */
+struct template {
+    const char *file;
+    char *source;
+    size_t size;
+    struct templateProgram path;
+    struct templateProgram body;
+    uint64_t hash;
+};
+
+/* Whether a template belongs to the per-table contexts, the shared context (-c) or both */
+enum specContext {
+    CONTEXT_ANY,
+    CONTEXT_PER_TABLE,
+    CONTEXT_SHARED
+};
+
+/* The option a template needs before it is rendered at all */
+enum specOption {
+    OPTION_NONE,
+    OPTION_METRICS,
+    OPTION_HARNESS
+};
+
+/*
+ Which template renders which file; the path is itself a template.
+ Schema templates render one file for all tables and are only used
+ with -S, since a single -t table is not the whole schema, unless they
+ have a tablePath: then -t renders them for its table into that file,
+ which may use the table variables.
+ */
+struct templateSpec {
+    const char *file;
+    const char *path;
+    int perSchema;
+    enum specContext context;
+    enum specOption option;
+    const char *tablePath;
+};
+
+/*
+ A single (table, template) job, or (schema, template) for schema
+ templates. generateFile fills in entry and status, which are read
+ back once every thread has finished.
+ */
+struct genJob {
+    const struct tableDef *tables;
+    int tableCount;
+    uint64_t schemaHash;
+    struct arena *arena;
+    const struct template *tmpl;
+    char fileName[MAX_FILE_STRING];
+    int onDisk;
+    uint64_t diskHash;
+    const struct manifestEntry *previous;
+    struct manifestEntry entry;
+    enum fileStatus status;
+};
 
 /* Prototypes */
-void getCommandLine(int argc, char **argv);
-void fileAccess(char *fileName, FILE **file_ptr);
-void writeModelFile();
-void writeDisplayModel();
-void writeContextFile();
-void writeInterface();
-void writeRepository();
-void writeController();
-void cleanup();
+void getCommandLine(int argc, char **argv, struct tableDef *def);
+void generateFile(struct genJob *job);
+int specEnabled(const struct templateSpec *spec);
+const char *specPath(const struct templateSpec *spec);
+int loadTemplate(const char *dir, const struct templateSpec *spec, struct template *tmpl);
+int compileTemplate(const char *file, const char *src, size_t size, int perSchema, struct templateProgram *prog);
+void renderTemplate(const struct templateProgram *prog, const struct tableDef *tables, int tableCount,
+                    struct outBuffer *out);
+void freeTemplate(struct template *tmpl);
+int generateTables(struct tableDef *tables, int tableCount, int wholeSchema, int jobCount);
+void *generateWorker(void *arg);
+int beginFile(struct genJob *job, const char *fileName);
+void finishFile(struct genJob *job, const struct outBuffer *buf);
+uint64_t hashBytes(uint64_t hash, const void *data, size_t length);
+uint64_t hashString(uint64_t hash, const char *str);
+uint64_t hashTable(const struct tableDef *def);
+int hashFile(const char *fileName, uint64_t *hash);
+int loadManifest(const char *path, struct manifest *man);
+int saveManifest(const char *path, const struct manifest *man, struct arena *arena);
+const struct manifestEntry *findManifestEntry(const struct manifest *man, const char *path);
+void addManifestEntry(struct manifest *man, const struct manifestEntry *entry);
+int compareManifestEntries(const void *a, const void *b);
+int manifestEqual(const struct manifest *a, const struct manifest *b);
+void freeManifest(struct manifest *man);
+const char *fieldTypeName(enum fieldType type);
+void countAllocation(size_t size);
+char *countedStrndup(const char *str, size_t length);
+char *countedStrdup(const char *str);
+void *countedRealloc(void *ptr, size_t size);
+void *arenaAlloc(struct arena *arena, size_t size);
+void arenaReset(struct arena *arena);
+void arenaFree(struct arena *arena);
+void bufInit(struct outBuffer *buf, struct arena *arena);
+void bufAppend(struct outBuffer *buf, const char *str, size_t length);
+void bufCat(struct outBuffer *buf, ...);
+int joinStrings(char *dest, size_t size, ...);
+int commitFile(const char *fileName, const struct outBuffer *buf);
+int makeParents(const char *fileName);
+void removeTree(const char *dir);
+struct column *addColumn(struct tableDef *def, const char *name, enum fieldType type);
+void groupColumns(struct tableDef *def);
+int parseSchemaFile(const char *path, struct tableDef **tables, int *tableCount, int *tableCap);
+void freeTable(struct tableDef *def);
+void addAnnotation(const char *target, int foreignKey);
+void applyAnnotations(struct tableDef *tables, int tableCount);
+void addCache(const char *target);
+void applyCaches(struct tableDef *tables, int tableCount);
+void addRelation(const char *target);
+int applyRelations(struct tableDef *tables, int tableCount);
+void freeTables(struct tableDef *tables, int tableCount);
+int runBenchmark(int jobCount, FILE *results);
+
+static const struct templateSpec templateSpecs[] = {
+    { "Model.cs.tmpl", "Ario.API/Models/{{Table}}.cs", 0, CONTEXT_ANY, OPTION_NONE, NULL },
+    { "Display.cs.tmpl", "Ario.API/Models/DisplayModels/{{Api}}Display.cs", 0, CONTEXT_ANY, OPTION_NONE, NULL },
+    { "Context.cs.tmpl", "Ario.API/Contexts/{{Table}}Context.cs", 0, CONTEXT_PER_TABLE, OPTION_NONE, NULL },
+    { "Interface.cs.tmpl", "Ario.API/Repositories/Interfaces/I{{Api}}Repository.cs", 0, CONTEXT_ANY, OPTION_NONE, NULL },
+    { "Repository.cs.tmpl", "Ario.API/Repositories/{{Api}}Repository.cs", 0, CONTEXT_ANY, OPTION_NONE, NULL },
+    { "Controller.cs.tmpl", "Ario.API/Controllers/{{Api}}Controller.cs", 0, CONTEXT_ANY, OPTION_NONE, NULL },
+    { "Indexes.sql.tmpl", "ArioDatabaseIndexes.sql", 1, CONTEXT_ANY, OPTION_NONE, "ArioDatabaseIndexes.{{Table}}.sql" },
+    { "SharedContext.cs.tmpl", "Ario.API/Contexts/{{SharedContext}}.cs", 1, CONTEXT_SHARED, OPTION_NONE, NULL },
+    { "Services.cs.tmpl", "Ario.API/{{SharedContext}}Services.cs", 1, CONTEXT_SHARED, OPTION_NONE, NULL },
+    { "MeteredRepository.cs.tmpl", "Ario.API/Repositories/{{Api}}MeteredRepository.cs", 0, CONTEXT_ANY, OPTION_METRICS, NULL },
+    { "MetricsController.cs.tmpl", "Ario.API/Controllers/MetricsController.cs", 1, CONTEXT_ANY, OPTION_METRICS, NULL },
+    { "MetricsServices.cs.tmpl", "Ario.API/RepositoryMetricsServices.cs", 1, CONTEXT_ANY, OPTION_METRICS, NULL },
+    { "Benchmarks.cs.tmpl", "Ario.Bench/RepositoryBenchmarks.cs", 1, CONTEXT_ANY, OPTION_HARNESS, NULL }
+};
+
+#define TEMPLATE_COUNT ((int) (sizeof(templateSpecs) / sizeof(templateSpecs[0])))
 
 /* Global variables for command line parameters */
-char *tableName;
-char *APICallName;
+const char **schemaFiles = NULL;
+int schemaIndex = 0;
+int jobCount = 1;
+const char *templateDir = TEMPLATE_DIR;
+int pageSize = 0;
+char pageSizeText[16] = "0";
+char sharedContext[MAX_FILE_STRING] = "";
+int asyncMode = 0;
+int streamMode = 0;
+int sparseMode = 0;
+int metricsMode = 0;
+int harnessMode = 0;
+struct annotation *annotations = NULL;
+int annotationCount = 0;
+const char **relations = NULL;
+int relationCount = 0;
+const char **caches = NULL;
+int cacheCount = 0;
+enum overwriteMode overwriteMode = OVERWRITE_GENERATED;
+int benchTables = 0;
+int benchColumns = 0;
+int benchRuns = 1;
+
+/* Counted for --bench; updated atomically since every generator thread adds to them */
+uint64_t allocations = 0;
+uint64_t allocatedBytes = 0;
+uint64_t renderedFiles = 0;
+uint64_t renderedBytes = 0;
+char benchDir[MAX_FILE_STRING] = "";
 
-char **strings;
-char **ints;
-char **decimals;
+/* Permissions for new files, taken from the umask at startup */
+mode_t fileMode = 0644;
 
-int stringIndex = 0;
-int intIndex = 0;
-int decIndex = 0;
+/* Files recorded by the previous run; only read while the workers run */
+struct manifest previousManifest;
+
+/* Compiled templates, in the same order as templateSpecs */
+struct template templates[TEMPLATE_COUNT];
+
+/* Work queue shared by the generator threads: one job per table and template */
+struct workQueue {
+    struct genJob *jobs;
+    int jobTotal;
+    int nextJob;
+    pthread_mutex_t lock;
+};
 
 int main(int argc, char **argv) {
     
-    tableName = (char *) malloc(MAX_NAME_STRING * sizeof(char));
-    APICallName = (char *) malloc(MAX_CALL_STRING * sizeof(char));
+    struct tableDef cmdTable;
+    memset(&cmdTable, 0, sizeof(struct tableDef));
     
-    strings = (char **) malloc(MAX_STRINGS * sizeof(char *));
-    ints = (char **) malloc(MAX_INTS * sizeof(char *));
-    decimals = (char **) malloc(MAX_DECIMALS * sizeof(char *));
+    getCommandLine(argc, argv, &cmdTable);
     
-    getCommandLine(argc, argv);
-    
-    if (tableName[0] == '\0') {
-        printf("Please enter a table name using the -t option.\n");
-        exit(1);
-    } else {
-        
-        if(APICallName[0] == '\0') {
-            strcpy(APICallName, tableName);
+    /* --bench keeps stdout for its JSON lines, so every message goes to stderr instead */
+    FILE *results = stdout;
+    if(benchTables > 0) {
+        int fd = dup(STDOUT_FILENO);
+        results = (fd == -1) ? NULL : fdopen(fd, "w");
+        if(results == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+            fprintf(stderr, "ERROR: Could not separate results from messages: %s\n", strerror(errno));
+            exit(1);
         }
-        
-        writeModelFile();
-        writeDisplayModel();
-        writeContextFile();
-        writeInterface();
-        writeRepository();
-        writeController();
+        setvbuf(stdout, NULL, _IOLBF, 0);
     }
     
-    //cleanup();
+    mode_t mask = umask(0);
+    umask(mask);
+    fileMode = 0666 & ~mask;
     
-    return 0;
-}
-
-void writeModelFile() {
-    FILE *file_ptr = NULL;
-    char *fileName = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-    strcpy(fileName, "Ario.API/Models/");
-    strcat(fileName, tableName);
-    strcat(fileName, ".cs");
+    if(loadManifest(MANIFEST_FILE, &previousManifest) != 0) {
+        exit(1);
+    }
     
-    fileAccess(fileName, &file_ptr);
+    int t = 0;
+    while(t < TEMPLATE_COUNT) {
+        if(specEnabled(&templateSpecs[t]) && loadTemplate(templateDir, &templateSpecs[t], &templates[t]) != 0) {
+            exit(1);
+        }
+        t++;
+    }
     
-    if(file_ptr != NULL) {
-        const char *string1 = "namespace Ario.API.Models\n{\n\tpublic class ";
-        fprintf(file_ptr, "%s%s%s", string1, tableName, "\n\t{\n");
+    int status = 0;
+    if (benchTables > 0) {
+        status = runBenchmark(jobCount, results);
+        fclose(results);
+    } else if (schemaIndex > 0) {
+        struct tableDef *tables = NULL;
+        int tableCount = 0;
+        int tableCap = 0;
         
-        char *tempString;
         int i = 0;
-        while(i < intIndex) {
-            tempString = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString, "\t\tpublic int? %s { get; set; }\n", ints[i]);
-            fprintf(file_ptr, "%s", tempString);
-            free(tempString);
+        while(i < schemaIndex) {
+            if(parseSchemaFile(schemaFiles[i], &tables, &tableCount, &tableCap) != 0) {
+                exit(1);
+            }
             i++;
         }
-        i = 0;
-        while(i < stringIndex) {
-            tempString = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString, "\t\tpublic string %s { get; set; }\n", strings[i]);
-            fprintf(file_ptr, "%s", tempString);
-            free(tempString);
-            i++;
+        
+        if(tableCount == 0) {
+            printf("No CREATE TABLE statements found in the schema files.\n");
+            exit(1);
         }
-        i = 0;
-        while(i < decIndex) {
-            tempString = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString, "\t\tpublic decimal? %s { get; set; }\n", decimals[i]);
-            fprintf(file_ptr, "%s", tempString);
-            free(tempString);
-            i++;
+        
+        applyAnnotations(tables, tableCount);
+        applyCaches(tables, tableCount);
+        if(applyRelations(tables, tableCount) != 0) {
+            exit(1);
         }
-        fprintf(file_ptr, "\t}\n}\n");
+        status = generateTables(tables, tableCount, 1, jobCount);
         
-        fclose(file_ptr);
-        free(fileName);
+        freeTables(tables, tableCount);
+    } else if (cmdTable.name == NULL) {
+        printf("Please enter a table name using the -t option or a schema file using -S.\n");
+        exit(1);
+    } else if (sharedContext[0] != '\0') {
+        /* The shared context lists every table, so a single table would get a repository with no context file */
+        printf("ERROR: -c needs the whole schema, so it only works with -S.\n");
+        exit(1);
+    } else {
+        
+        if(cmdTable.apiName == NULL) {
+            cmdTable.apiName = countedStrdup(cmdTable.name);
+        }
+        if(cmdTable.key == NULL) {
+            cmdTable.key = countedStrdup("ID");
+        }
+        
+        groupColumns(&cmdTable);
+        applyAnnotations(&cmdTable, 1);
+        applyCaches(&cmdTable, 1);
+        if(relationCount > 0) {
+            printf("WARNING: -r needs both tables, so it is ignored without -S.\n");
+        }
+        if(metricsMode) {
+            printf("WARNING: --metrics without -S only writes the metered repository; api/metrics and AddRepositoryMetrics() cover the whole schema and are not written.\n");
+        }
+        if(harnessMode) {
+            printf("WARNING: --harness covers the whole schema, so it is ignored without -S.\n");
+        }
+        status = generateTables(&cmdTable, 1, 0, jobCount);
+    }
+    
+    freeTable(&cmdTable);
+    freeManifest(&previousManifest);
+    free(schemaFiles);
+    free(annotations);
+    free(relations);
+    free(caches);
+    t = 0;
+    while(t < TEMPLATE_COUNT) {
+        freeTemplate(&templates[t]);
+        t++;
+    }
+    
+    return status;
+}
+
+/* Templates for the other context mode, or for an option that was not given, are neither loaded nor rendered */
+int specEnabled(const struct templateSpec *spec) {
+    if((spec->option == OPTION_METRICS && !metricsMode) || (spec->option == OPTION_HARNESS && !harnessMode)) {
+        return 0;
+    }
+    if(spec->context == CONTEXT_ANY) {
+        return 1;
+    }
+    return (spec->context == CONTEXT_SHARED) == (sharedContext[0] != '\0');
+}
+
+/* A schema template rendered for the single -t table is written to its tablePath */
+const char *specPath(const struct templateSpec *spec) {
+    if(spec->perSchema && spec->tablePath != NULL && schemaIndex == 0 && benchTables == 0) {
+        return spec->tablePath;
     }
+    return spec->path;
 }
 
-void writeDisplayModel() {
-    FILE *file_ptr = NULL;
-    char *fileName = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-    strcpy(fileName, "Ario.API/Models/DisplayModels/");
-    strcat(fileName, APICallName);
-    strcat(fileName, "Display.cs");
+static void addJob(struct workQueue *queue, const struct tableDef *tables, int tableCount,
+                   uint64_t schemaHash, const struct template *tmpl) {
+    struct genJob *job = &queue->jobs[queue->jobTotal++];
+    job->tables = tables;
+    job->tableCount = tableCount;
+    job->schemaHash = schemaHash;
+    job->tmpl = tmpl;
+    job->status = FILE_FAILED;
+}
+
+/*
+ Renders every template for every table, and with wholeSchema every
+ schema template once. With more than one job the (table, template)
+ pairs are handed out to a pool of threads. Returns nonzero if a file
+ could not be written, or with --check if any file is out of date.
+ */
+int generateTables(struct tableDef *tables, int tableCount, int wholeSchema, int jobCount) {
+    struct workQueue queue;
+    queue.jobTotal = 0;
+    queue.nextJob = 0;
+    queue.jobs = (struct genJob *) calloc(tableCount * TEMPLATE_COUNT, sizeof(struct genJob));
+    if(queue.jobs == NULL) {
+        printf("ERROR: Out of memory.\n");
+        exit(1);
+    }
+    countAllocation(tableCount * TEMPLATE_COUNT * sizeof(struct genJob));
+    pthread_mutex_init(&queue.lock, NULL);
+    
+    uint64_t schemaHash = FNV_OFFSET;
+    int t = 0;
+    while(t < tableCount) {
+        tables[t].schemaHash = hashTable(&tables[t]);
+        schemaHash = hashBytes(schemaHash, &tables[t].schemaHash, sizeof(uint64_t));
+        t++;
+    }
     
-    fileAccess(fileName, &file_ptr);
+    int s = 0;
+    while(s < TEMPLATE_COUNT) {
+        if(!specEnabled(&templateSpecs[s])) {
+            /* Rendered only in the other context mode, or only with --metrics or --harness */
+        } else if(!templateSpecs[s].perSchema) {
+            t = 0;
+            while(t < tableCount) {
+                addJob(&queue, &tables[t], 1, tables[t].schemaHash, &templates[s]);
+                t++;
+            }
+        } else if(wholeSchema || templateSpecs[s].tablePath != NULL) {
+            addJob(&queue, tables, tableCount, schemaHash, &templates[s]);
+        }
+        s++;
+    }
     
-    if(file_ptr != NULL) {
+    if(jobCount > queue.jobTotal) {
+        jobCount = queue.jobTotal;
+    }
     
-        const char *string1 = "namespace Ario.API.Models.DisplayModels\n{\n\tpublic class ";
-        const char *string2 = "Display\n\t{\n";
-        fprintf(file_ptr, "%s%s%s", string1, APICallName, string2);
+    if(jobCount <= 1) {
+        generateWorker(&queue);
+    } else {
+        pthread_t *threads = (pthread_t *) malloc(jobCount * sizeof(pthread_t));
+        countAllocation(jobCount * sizeof(pthread_t));
+        int started = 0;
+        while(started < jobCount) {
+            if(pthread_create(&threads[started], NULL, generateWorker, &queue) != 0) {
+                printf("WARNING: Could only start %d generator threads.\n", started);
+                break;
+            }
+            started++;
+        }
+        if(started == 0) {
+            generateWorker(&queue);
+        }
         
-        char *tempString;
         int i = 0;
-        while(i < intIndex) {
-            tempString = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString, "\t\tpublic int? %s { get; set; }\n", ints[i]);
-            fprintf(file_ptr, "%s", tempString);
-            free(tempString);
+        while(i < started) {
+            pthread_join(threads[i], NULL);
             i++;
         }
-        i = 0;
-        while(i < stringIndex) {
-            tempString = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString, "\t\tpublic string %s { get; set; }\n", strings[i]);
-            fprintf(file_ptr, "%s", tempString);
-            free(tempString);
-            i++;
+        free(threads);
+    }
+    
+    pthread_mutex_destroy(&queue.lock);
+    
+    if(benchTables > 0) {
+        /* The files went to the scratch directory, so there is no manifest to update */
+        int failed = 0;
+        int b = 0;
+        while(b < queue.jobTotal) {
+            failed |= (queue.jobs[b].status == FILE_FAILED);
+            b++;
         }
-        i = 0;
-        while(i < decIndex) {
-            tempString = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString, "\t\tpublic decimal? %s { get; set; }\n", decimals[i]);
-            fprintf(file_ptr, "%s", tempString);
-            free(tempString);
-            i++;
+        free(queue.jobs);
+        return failed;
+    }
+    
+    /* The new manifest keeps entries for files this run did not touch */
+    int counts[FILE_FAILED + 1] = { 0 };
+    struct manifest next = { NULL, 0, 0 };
+    char *carried = (char *) calloc(previousManifest.count + 1, 1);
+    countAllocation(previousManifest.count + 1);
+    int j = 0;
+    while(j < queue.jobTotal) {
+        struct genJob *job = &queue.jobs[j];
+        counts[job->status]++;
+        if(job->previous != NULL) {
+            carried[job->previous - previousManifest.entries] = 1;
         }
-        fprintf(file_ptr, "\t}\n}\n");
-        
-        fclose(file_ptr);
-        free(fileName);
+        if(job->entry.path != NULL) {
+            addManifestEntry(&next, &job->entry);
+        }
+        j++;
+    }
+    int i = 0;
+    while(i < previousManifest.count) {
+        if(!carried[i]) {
+            struct manifestEntry entry = previousManifest.entries[i];
+            entry.path = countedStrdup(entry.path);
+            addManifestEntry(&next, &entry);
+        }
+        i++;
+    }
+    free(carried);
+    free(queue.jobs);
+    qsort(next.entries, next.count, sizeof(struct manifestEntry), compareManifestEntries);
+    
+    int status = (counts[FILE_FAILED] > 0);
+    if(overwriteMode == OVERWRITE_CHECK) {
+        printf("%d of %d files are out of date.\n", counts[FILE_STALE], queue.jobTotal);
+        status |= (counts[FILE_STALE] > 0);
+    } else {
+        printf("Generated %d tables: %d files written, %d unchanged, %d skipped.\n", tableCount,
+               counts[FILE_WRITTEN], counts[FILE_UNCHANGED], counts[FILE_SKIPPED]);
+        if(!manifestEqual(&previousManifest, &next)) {
+            struct arena arena = { NULL, NULL };
+            status |= (saveManifest(MANIFEST_FILE, &next, &arena) != 0);
+            arenaFree(&arena);
+        }
+    }
+    if(counts[FILE_FAILED] > 0) {
+        printf("ERROR: %d files could not be generated.\n", counts[FILE_FAILED]);
     }
     
+    freeManifest(&next);
+    return status;
 }
 
-void writeContextFile() {
-    FILE *file_ptr = NULL;
-    char *fileName = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-    strcpy(fileName, "Ario.API/Contexts/");
-    strcat(fileName, tableName);
-    strcat(fileName, "Context.cs");
+void *generateWorker(void *arg) {
+    struct workQueue *queue = (struct workQueue *) arg;
+    struct arena arena = { NULL, NULL };
     
-    fileAccess(fileName, &file_ptr);
-    
-    if(file_ptr != NULL) {
-        char *strContext = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-        strcpy(strContext, tableName);
-        strcat(strContext, "Context");
-        
-        const char *string1 = "using Ario.API.Models;\nusing Microsoft.EntityFrameworkCore;\n\n";
-        const char *string2 = "namespace Ario.API.Contexts\n{\n\tpublic class ";
-        const char *string3 = " : DbContext\n\t{\n\t\tpublic ";
-        const char *string4 = "(DbContextOptions<";
-        const char *string5 = "> options)\n\t\t\t: base(options) { }\n\n\t\tprotected override void OnModelCreating(ModelBuilder modelBuilder)\n\t\t{\n\t\t\tmodelBuilder.Entity<";
-        const char *string6 = ">().HasKey(x => x.ID);\n\t\t\tbase.OnModelCreating(modelBuilder);\n\t\t}\n\n\t\tpublic DbSet<";
-        const char *string7 = " { get; set; }\n\t}\n}";
+    for(;;) {
+        pthread_mutex_lock(&queue->lock);
+        int index = queue->nextJob++;
+        pthread_mutex_unlock(&queue->lock);
         
-        fprintf(file_ptr, "%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n", string1, string2, strContext,
-               string3, strContext, string4, strContext, string5, tableName,
-               string6, tableName, "> ", tableName, string7);
-        
-        fclose(file_ptr);
-        free(fileName);
-        free(strContext);
+        if(index >= queue->jobTotal) {
+            break;
+        }
+        struct genJob *job = &queue->jobs[index];
+        job->arena = &arena;
+        generateFile(job);
+        job->arena = NULL;
+        arenaReset(&arena);
+    }
+    
+    arenaFree(&arena);
+    return NULL;
+}
+
+const char *fieldTypeName(enum fieldType type) {
+    switch (type) {
+        case FIELD_INT:
+            return "int?";
+        case FIELD_LONG:
+            return "long?";
+        case FIELD_DECIMAL:
+            return "decimal?";
+        case FIELD_STRING:
+        default:
+            return "string";
     }
 }
 
-void writeInterface() {
-    FILE *file_ptr = NULL;
-    char *fileName = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-    strcpy(fileName, "Ario.API/Repositories/Interfaces/");
-    strcat(fileName, "I");
-    strcat(fileName, APICallName);
-    strcat(fileName, "Repository.cs");
-    
-    fileAccess(fileName, &file_ptr);
+/* Output buffers */
+
+/* Every heap allocation made while tables are built and generated is counted, so --bench can report them */
+void countAllocation(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocatedBytes, size, __ATOMIC_RELAXED);
+}
+
+/* strdup, strndup and realloc that count what they allocate and stop when memory runs out */
+char *countedStrndup(const char *str, size_t length) {
+    char *copy = strndup(str, length);
+    if(copy == NULL) {
+        printf("ERROR: Out of memory.\n");
+        exit(1);
+    }
+    countAllocation(strlen(copy) + 1);
+    return copy;
+}
+
+char *countedStrdup(const char *str) {
+    return countedStrndup(str, strlen(str));
+}
+
+void *countedRealloc(void *ptr, size_t size) {
+    void *grown = realloc(ptr, size);
+    if(grown == NULL) {
+        printf("ERROR: Out of memory.\n");
+        exit(1);
+    }
+    countAllocation(size);
+    return grown;
+}
+
+static struct arenaBlock *arenaNewBlock(size_t size) {
+    size_t blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    struct arenaBlock *block = (struct arenaBlock *) malloc(sizeof(struct arenaBlock) + blockSize);
+    if(block == NULL) {
+        printf("ERROR: Out of memory.\n");
+        exit(1);
+    }
+    block->next = NULL;
+    block->size = blockSize;
+    block->used = 0;
+    countAllocation(sizeof(struct arenaBlock) + blockSize);
+    return block;
+}
+
+void *arenaAlloc(struct arena *arena, size_t size) {
+    size = (size + 7) & ~(size_t) 7;
     
-    if(file_ptr != NULL) {
-        const char *string1 = "using System.Collections.Generic;\nusing Ario.API.Models;\nusing Ario.API.Models.DisplayModels;\n\nnamespace Ario.API.Repositories\n{\n\tpublic interface I";
-        const char *string2 = "Repository\n\t{\n\t\tvoid Add(";
-        const char *string3 = " item);\n\t\tIEnumerable<";
-        const char *string4 = "> GetAll();\n\t\tIEnumerable<";
-        const char *string5 = "Display> GetAll(";
-        const char *string6 = " Find(int id);\n\t\tvoid Remove(int id);\n\t\tvoid Update(";
-        const char *string7 = " item);\n\t}\n}";
-        
-        fprintf(file_ptr,"%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n", string1, APICallName, string2,
-               tableName, string3, tableName, string4, APICallName, string5,
-               tableName, " item);\n\t\t", tableName, string6, tableName, string7);
-        
-        fclose(file_ptr);
-        free(fileName);
-    }
-}
-
-void writeRepository() {
-    FILE *file_ptr = NULL;
-    char *fileName = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-    strcpy(fileName, "Ario.API/Repositories/");
-    strcat(fileName, APICallName);
-    strcat(fileName, "Repository.cs");
-    
-    fileAccess(fileName, &file_ptr);
-    
-    if(file_ptr != NULL) {
-        const char *string1 = "using System.Collections.Generic;\nusing System.Linq;\nusing Ario.API.Models;\nusing Ario.API.Contexts;\nusing Ario.API.Models.DisplayModels;\nusing System;\nusing System.Reflection;\nusing Ario.API.Attributes;\n\nnamespace Ario.API.Repositories\n{\n\tpublic class ";
-        const char *string2 = "Repository : I";
-        const char *string3 = "Repository\n\t{\n\t\t";
-        const char *string4 = "Context _context;\n\t\tpublic ";
-        const char *string5 = "Repository(";
-        const char *string6 = "Context context)\n\t\t{\n\t\t\t_context = context;\n\t\t}\n\n\t\tpublic void Add(";
-        const char *string7 = " item)\n\t\t{\n\t\t\t_context.";
-        const char *string8 = ".Add(item);\n\t\t\t_context.SaveChanges();\n\t\t}\n\n\t\tpublic ";
-        const char *string9 = " Find(int id)\n\t\t{\n\t\t\treturn _context.";
-        const char *string10 = ".Where(e => e.ID == id).SingleOrDefault();\n\t\t}\n\n\t\tpublic IEnumerable<";
-        const char *string11 = "> GetAll()\n\t\t{\n\t\t\treturn _context.";
-        const char *string12 = ".ToList();\n\t\t}\n\n\t\tpublic IEnumerable<";
-        const char *string13 = "Display> GetAll(";
-        const char *string14 = " item)\n\t\t{\n\n\t\t\tList<";
-        const char *string15 = "Display> displayList = new List<";
-        const char *string16 = "Display>();\n\n\t\t\tif (item != null)\n\t\t\t{\n\t\t\t\tList<";
-        const char *string17 = "> tempList =\n\t\t\t\t\t_context.";
-        const char *string18 = ".ToList();\n\t\t\t\tList<";
-        const char *string02 = "> list = new List<";
-        const char *string03 = ">();\n\n\t\t\t\tforeach(";
-        const char *string04 = " entry in tempList) {\n\t\t\t\t\tbool match = true;\n\t\t\t\t\tType type = entry.GetType();\n\t\t\t\t\tforeach (PropertyInfo propertyInfo in type.GetProperties())\n\t\t\t\t\t{\n\t\t\t\t\t\tif (propertyInfo.CanRead)\n\t\t\t\t\t\t{\n\t\t\t\t\t\t\tif (propertyInfo.GetValue(item) != null && !propertyInfo.GetValue(item).ToString().Equals(\"0\"))\n\t\t\t\t\t\t\t{if(Attribute.IsDefined(propertyInfo, typeof(BlackListed))) {\n\t\t\t\t\t\t\t\t\tmatch = false;\n\t\t\t\t\t\t\t\t\tbreak;\n\t\t\t\t\t\t\t\t}\n\t\t\t\t\t\t\t\tif(propertyInfo.GetValue(entry) == null) {\n\t\t\t\t\t\t\t\t\tmatch = false;\n\t\t\t\t\t\t\t\t\tbreak;\n\t\t\t\t\t\t\t\t}\n\t\t\t\t\t\t\t\tif (!propertyInfo.GetValue(entry).Equals(propertyInfo.GetValue(item)))\n\t\t\t\t\t\t\t\t{\n\t\t\t\t\t\t\t\t\tmatch = false;\n\t\t\t\t\t\t\t\t\tbreak;\n\t\t\t\t\t\t\t\t}\n\t\t\t\t\t\t\t}\n\t\t\t\t\t\t}\n\t\t\t\t\t}\n\t\t\t\t\tif(match) {\n\t\t\t\t\t\tlist.Add(entry);\n\t\t\t\t\t}\n\t\t\t\t}\n\n\t\t\t\tforeach (";
-        const char *string19 = " t in list)\n\t\t\t\t{\n\t\t\t\t\t";
-        const char *string20 = "Display disp = new ";
-        const char *string21 = "Display();\n";
-        const char *string01 = "\t\t\t\t\tdisplayList.Add(disp);\n\t\t\t\t}\n\t\t\t}\n\n\t\t\treturn displayList;\n\t\t}\n\n\t\tpublic void Remove(int id)\n\t\t{\n\t\t\tvar itemToRemove = _context.";
-        const char *string22 = ".SingleOrDefault(r => r.ID == id);\n\t\t\tif (itemToRemove != null)\n\t\t\t{\n\t\t\t\t_context.";
-        const char *string23 = ".Remove(itemToRemove);\n\t\t\t\t_context.SaveChanges();\n\t\t\t}\n\n\t\t}\n\n\t\tpublic void Update(";
-        const char *string24 = " item)\n\t\t{\n\t\t\tvar itemToUpdate = _context.";
-        const char *string25 = ".SingleOrDefault(r => r.ID == item.ID);\n\t\t\tif (itemToUpdate != null)\n\t\t\t{\n";
-        const char *string26 = "\t\t\t\t_context.SaveChanges();\n\t\t\t}\n\t\t}\n\t}\n}\n";
-        
-        fprintf(file_ptr,"%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s",
-               string1, APICallName, string2, APICallName, string3, tableName, string4, APICallName,
-               string5, tableName, string6, tableName, string7, tableName, string8, tableName,
-               string9, tableName, string10, tableName, string11, tableName, string12, APICallName,
-               string13, tableName, string14, APICallName, string15, APICallName, string16, tableName,
-               string17, tableName, string18, tableName, string02, tableName, string03, tableName, string04, tableName, string19, APICallName, string20, APICallName,
-               string21);
-        
-//        , tableName, string22, tableName, string23, tableName, string24, tableName,
-//        string25
-        
-        char *tempString1;
-        int i = 0;
-        while(i < intIndex) {
-            tempString1 = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString1, "\t\t\t\t\tdisp.%s = t.%s;\n", ints[i], ints[i]);
-            fprintf(file_ptr, "%s", tempString1);
-            free(tempString1);
-            i++;
-        }
-        i = 0;
-        while(i < stringIndex) {
-            tempString1 = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString1, "\t\t\t\t\tdisp.%s = t.%s;\n", strings[i], strings[i]);
-            fprintf(file_ptr, "%s", tempString1);
-            free(tempString1);
-            i++;
+    struct arenaBlock *block = arena->current;
+    if(block == NULL) {
+        block = arenaNewBlock(size);
+        arena->head = block;
+    }
+    while(block->size - block->used < size) {
+        if(block->next == NULL) {
+            block->next = arenaNewBlock(size);
         }
-        i = 0;
-        while(i < decIndex) {
-            tempString1 = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString1, "\t\t\t\t\tdisp.%s = t.%s;\n", decimals[i], decimals[i]);
-            fprintf(file_ptr, "%s", tempString1);
-            free(tempString1);
-            i++;
+        block = block->next;
+        block->used = 0;
+    }
+    arena->current = block;
+    
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void arenaReset(struct arena *arena) {
+    arena->current = arena->head;
+    if(arena->current != NULL) {
+        arena->current->used = 0;
+    }
+}
+
+void arenaFree(struct arena *arena) {
+    while(arena->head != NULL) {
+        struct arenaBlock *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->current = NULL;
+}
+
+void bufInit(struct outBuffer *buf, struct arena *arena) {
+    buf->arena = arena;
+    buf->data = (char *) arenaAlloc(arena, OUTPUT_INITIAL_SIZE);
+    buf->length = 0;
+    buf->cap = OUTPUT_INITIAL_SIZE;
+}
+
+void bufAppend(struct outBuffer *buf, const char *str, size_t length) {
+    if(buf->length + length > buf->cap) {
+        size_t cap = buf->cap * 2;
+        while(cap < buf->length + length) {
+            cap *= 2;
         }
-        fprintf(file_ptr, "%s%s%s%s%s%s%s%s%s", string01, tableName, string22, tableName, string23, tableName, string24, tableName, string25);
         
-        char *tempString2;
-        i = 0;
-        while(i < intIndex) {
-            tempString2 = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString2, "\t\t\t\titemToUpdate.%s = item.%s;\n", ints[i], ints[i]);
-            fprintf(file_ptr, "%s", tempString2);
-            free(tempString2);
-            i++;
-        }
-        i = 0;
-        while(i < stringIndex) {
-            tempString2 = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString2, "\t\t\t\titemToUpdate.%s = item.%s;\n", strings[i], strings[i]);
-            fprintf(file_ptr, "%s", tempString2);
-            free(tempString2);
-            i++;
+        /* Grow in place when the buffer is the last thing in its block */
+        struct arenaBlock *block = buf->arena->current;
+        if(block != NULL && buf->data + buf->cap == block->data + block->used
+           && block->size - block->used >= cap - buf->cap) {
+            block->used += cap - buf->cap;
+        } else {
+            char *data = (char *) arenaAlloc(buf->arena, cap);
+            memcpy(data, buf->data, buf->length);
+            buf->data = data;
         }
-        i = 0;
-        while(i < decIndex) {
-            tempString2 = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-            sprintf(tempString2, "\t\t\t\titemToUpdate.%s = item.%s;\n", decimals[i], decimals[i]);
-            fprintf(file_ptr, "%s", tempString2);
-            free(tempString2);
-            i++;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->length, str, length);
+    buf->length += length;
+}
+
+/* Appends each string argument in turn; the list ends with NULL */
+void bufCat(struct outBuffer *buf, ...) {
+    va_list args;
+    va_start(args, buf);
+    const char *str;
+    while((str = va_arg(args, const char *)) != NULL) {
+        bufAppend(buf, str, strlen(str));
+    }
+    va_end(args);
+}
+
+/* Concatenates the NULL terminated string arguments into dest, failing rather than overflowing */
+int joinStrings(char *dest, size_t size, ...) {
+    va_list args;
+    va_start(args, size);
+    size_t length = 0;
+    const char *str;
+    while((str = va_arg(args, const char *)) != NULL) {
+        size_t part = strlen(str);
+        if(length + part >= size) {
+            va_end(args);
+            dest[length] = '\0';
+            printf("ERROR: Name too long: %s%s...\n", dest, str);
+            return -1;
         }
-        fprintf(file_ptr, "%s\n", string26);
-        
-        fclose(file_ptr);
-        free(fileName);
-    }
-}
-
-void writeController() {
-    FILE *file_ptr = NULL;
-    char *fileName = (char *) malloc(MAX_FILE_STRING * sizeof(char));
-    strcpy(fileName, "Ario.API/Controllers/");
-    strcat(fileName, APICallName);
-    strcat(fileName, "Controller.cs");
-    
-    fileAccess(fileName, &file_ptr);
-    
-    if(file_ptr != NULL) {
-        const char *string1 = "using Ario.API.Models;\nusing Ario.API.Repositories;\nusing Microsoft.AspNetCore.Mvc;\nusing System.Collections.Generic;\nusing Ario.API.Models.DisplayModels;\n\nnamespace Ario.API.Controllers\n{\n\t[Route(\"api/[controller]\")]\n\tpublic class ";
-        const char *string2 = "Controller : Controller\n\t{\n\t\tpublic I";
-        const char *string3 = "Repository ";
-        const char *string4 = "Repo { get; set; }\n\n\t\tpublic ";
-        const char *string5 = "Controller(I";
-        const char *string6 = "Repository _repo)\n\t\t{\n\t\t\t";
-        const char *string7 = "Repo = _repo;\n\t\t}\n\n\t\t[HttpGet(\"all\")]\n\t\tpublic IEnumerable<";
-        const char *string8 = "> GetAll()\n\t\t{\n\t\t\treturn ";
-        const char *string9 = "Repo.GetAll();\n\t\t}\n\n\t\t[HttpGet]\n\t\tpublic IEnumerable<";
-        const char *string10 = "Display> GetAll([FromQuery] ";
-        const char *string11 = " item)\n\t\t{\n\t\t\treturn ";
-        const char *string12 = "Repo.GetAll(item);\n\t\t}\n\n\t\t[HttpGet(\"{id}\", Name = \"";
-        const char *string13 = "\")]\n\t\tpublic IActionResult GetById(int id)\n\t\t{\n\t\t\tvar item = ";
-        const char *string14 = "Repo.Find(id);\n\t\t\tif (item == null)\n\t\t\t{\n\t\t\t\treturn NotFound();\n\t\t\t}\n\t\t\treturn new ObjectResult(item);\n\t\t}\n\n\t\t[HttpPost]\n\t\tpublic IActionResult Create([FromBody] ";
-        const char *string15 = " item)\n\t\t{\n\t\t\tif (item == null)\n\t\t\t{\n\t\t\t\treturn BadRequest();\n\t\t\t}\n\t\t\t";
-        const char *string16 = "Repo.Add(item);\n\t\t\treturn CreatedAtRoute(\"";
-        const char *string17 = "\", new { Controller = \"";
-        const char *string18 = "\", id = item.ID }, item);\n\t\t}\n\n\t\t[HttpPut(\"{id}\")]\n\t\tpublic IActionResult Update(int id, [FromBody] ";
-        const char *string19 = " item)\n\t\t{\n\t\t\tif (item == null)\n\t\t\t{\n\t\t\t\treturn BadRequest();\n\t\t\t}\n\t\t\tvar contactObj = ";
-        const char *string20 = "Repo.Find(id);\n\t\t\tif (contactObj == null)\n\t\t\t{\n\t\t\t\treturn NotFound();\n\t\t\t}\n\t\t\t";
-        const char *string21 = "Repo.Update(item);\n\t\t\treturn new NoContentResult();\n\t\t}\n\n\t\t[HttpDelete(\"{id}\")]\n\t\tpublic void Delete(int id)\n\t\t{\n\t\t\t";
-        const char *string22 = "Repo.Remove(id);\n\t\t}\n\t}\n}\n";
-
-        fprintf(file_ptr,"%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n", string1, APICallName, string2, APICallName, string3, tableName, string4, APICallName,
-               string5, APICallName, string6, tableName, string7, tableName, string8, tableName,
-               string9, APICallName, string10, tableName, string11, tableName, string12, APICallName,
-               string13, tableName, string14, tableName, string15, tableName, string16, APICallName,
-               string17, tableName, string18, tableName, string19, tableName, string20, tableName,
-               string21, tableName, string22);
-        
-        fclose(file_ptr);
-        free(fileName);
+        memcpy(dest + length, str, part);
+        length += part;
     }
+    va_end(args);
+    dest[length] = '\0';
+    return 0;
 }
 
-void getCommandLine(int argc, char **argv) {
+/*
+ Writes the buffer to a temporary file next to fileName and renames it
+ over the target, so an interrupted run never leaves a truncated file.
+ */
+int commitFile(const char *fileName, const struct outBuffer *buf) {
+    char tempName[MAX_FILE_STRING + 8];
+    if(joinStrings(tempName, sizeof(tempName), fileName, ".XXXXXX", NULL) != 0) {
+        return -1;
+    }
     
-    int c;
-    extern char *optarg;
+    int fd = mkstemp(tempName);
+    if(fd == -1) {
+        printf("ERROR: Could not create %s: %s\n", tempName, strerror(errno));
+        return -1;
+    }
     
-    while((c = getopt(argc, argv, "a:t:s:i:d:")) != -1) {
-        switch (c) {
-            case 't':
-                tableName = optarg;
-                break;
-            case 'a':
-                APICallName = optarg;
-                break;
-            case 's':
-                if(stringIndex < MAX_STRINGS) {
-                    strings[stringIndex] = (char *) malloc(MAX_NAME_STRING * sizeof(char));
-                    strings[stringIndex] = optarg;
-                    stringIndex++;
-                }
-                break;
-            case 'i':
-                if(intIndex < MAX_INTS) {
-                    ints[intIndex] = (char *) malloc(MAX_NAME_STRING * sizeof(char));
-                    ints[intIndex] = optarg;
-                    intIndex++;
-                }
-                break;
-            case 'd':
-                if(decIndex < MAX_DECIMALS) {
-                    decimals[decIndex] = (char *) malloc(MAX_NAME_STRING * sizeof(char));
-                    decimals[decIndex] = optarg;
-                    decIndex++;
-                }
-                break;
-            default:
-                printf("Generator command line options:\n");
-                printf(" -t \t enter name of the table (required)\n");
-                printf(" -a \t enter name of API call (default is table name)\n");
-                printf(" -s \t enter string field for model\n");
-                printf(" -i \t enter integer field for model\n");
-                printf(" -d \t enter decimal field for model\n");
-                exit(1);
+    size_t written = 0;
+    while(written < buf->length) {
+        ssize_t result = write(fd, buf->data + written, buf->length - written);
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            printf("ERROR: Could not write %s: %s\n", tempName, strerror(errno));
+            close(fd);
+            unlink(tempName);
+            return -1;
         }
+        written += (size_t) result;
+    }
+    
+    /* The descriptor is closed even if fchmod fails, so a failed file does not leak it */
+    int result = fchmod(fd, fileMode);
+    int error = errno;
+    if(close(fd) != 0 && result == 0) {
+        result = -1;
+        error = errno;
+    }
+    if(result == 0 && rename(tempName, fileName) != 0) {
+        result = -1;
+        error = errno;
     }
+    if(result != 0) {
+        printf("ERROR: Could not replace %s: %s\n", fileName, strerror(error));
+        unlink(tempName);
+        return -1;
+    }
+    return 0;
 }
 
-void fileAccess(char *fileName, FILE **file_ptr) {
-    if( access( fileName, F_OK ) == -1 ) {
-        *file_ptr = fopen(fileName, "w");
-    } else {
-        char confirm;
-        printf("%s already exists. Enter \"y\" to overwrite.\n", fileName);
-        confirm = getchar();
-        if(getchar() != '\n') {
-            printf("ERROR: Invalid input. Only input a single character.\n");
-            exit(1);
+/* Creates the directories above fileName that do not exist yet */
+int makeParents(const char *fileName) {
+    char dir[MAX_FILE_STRING];
+    if(joinStrings(dir, sizeof(dir), fileName, NULL) != 0) {
+        return -1;
+    }
+    char *slash = strchr(dir + 1, '/');
+    while(slash != NULL) {
+        *slash = '\0';
+        if(mkdir(dir, 0777) != 0 && errno != EEXIST) {
+            printf("ERROR: Could not create %s: %s\n", dir, strerror(errno));
+            return -1;
         }
-        
-        if(confirm == 'y') {
-            printf("Overwriting...\n");
-            *file_ptr = fopen(fileName, "w");
-        } else {
-            printf("%s was unchanged...\n", fileName);
-            return;
+        *slash = '/';
+        slash = strchr(slash + 1, '/');
+    }
+    return 0;
+}
+
+/* Removes dir and everything under it; only used on the --bench scratch directory */
+void removeTree(const char *dir) {
+    DIR *handle = opendir(dir);
+    if(handle != NULL) {
+        struct dirent *entry;
+        while((entry = readdir(handle)) != NULL) {
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            char path[MAX_FILE_STRING];
+            struct stat info;
+            if(joinStrings(path, sizeof(path), dir, "/", entry->d_name, NULL) != 0 || lstat(path, &info) != 0) {
+                continue;
+            }
+            if(S_ISDIR(info.st_mode)) {
+                removeTree(path);
+            } else {
+                unlink(path);
+            }
         }
+        closedir(handle);
     }
+    rmdir(dir);
 }
 
-void cleanup() {
+/* Incremental regeneration */
+
+/*
+ Looks the file up on disk and in the previous manifest. Returns 1 when
+ the file should be rendered, or 0 when it is already up to date or has
+ to be left alone.
+ */
+int beginFile(struct genJob *job, const char *fileName) {
+    if(joinStrings(job->fileName, sizeof(job->fileName), fileName, NULL) != 0) {
+        return 0;
+    }
     
-    int i = 0;
-    while(strings[i] != '\0' && i < MAX_STRINGS) {
-        free(strings[i]);
-        i++;
+    job->previous = findManifestEntry(&previousManifest, fileName);
+    if(job->previous != NULL) {
+        job->entry = *job->previous;
+        job->entry.path = countedStrdup(fileName);
     }
-    i = 0;
-    while(ints[i] != '\0' && i < MAX_INTS) {
-        free(ints[i]);
-        i++;
+    
+    if(overwriteMode == OVERWRITE_SKIP_EXISTING && access(fileName, F_OK) == 0) {
+        job->status = FILE_SKIPPED;
+        return 0;
     }
-    i = 0;
-    while(decimals[i] != '\0' && i < MAX_DECIMALS) {
-        free(decimals[i]);
-        i++;
+    
+    job->onDisk = (hashFile(fileName, &job->diskHash) == 0);
+    const struct manifestEntry *prev = job->previous;
+    if(job->onDisk && prev != NULL && prev->schemaHash == job->schemaHash
+       && prev->templateHash == job->tmpl->hash && prev->outputHash == job->diskHash) {
+        job->status = FILE_UNCHANGED;
+        return 0;
     }
+    return 1;
+}
+
+/*
+ Writes the rendered file unless the copy on disk already matches it.
+ A file that was edited after it was generated, or that the manifest
+ does not know about, is only replaced with --force.
+ */
+void finishFile(struct genJob *job, const struct outBuffer *buf) {
+    uint64_t outputHash = hashBytes(FNV_OFFSET, buf->data, buf->length);
     
-    free(strings);
-    free(ints);
-    free(decimals);
-//    free(tableName);
-//    free(APICallName);
+    if(job->onDisk && job->diskHash == outputHash) {
+        job->status = FILE_UNCHANGED;
+    } else if(overwriteMode == OVERWRITE_CHECK) {
+        printf("%s is out of date.\n", job->fileName);
+        job->status = FILE_STALE;
+        return;
+    } else if(job->onDisk && overwriteMode != OVERWRITE_FORCE
+              && (job->previous == NULL || job->previous->outputHash != job->diskHash)) {
+        printf("%s %s, use --force to overwrite it.\n", job->fileName,
+               job->previous == NULL ? "was not written by the generator" : "was edited after it was generated");
+        job->status = FILE_SKIPPED;
+        return;
+    } else if(commitFile(job->fileName, buf) != 0) {
+        job->status = FILE_FAILED;
+        return;
+    } else {
+        job->status = FILE_WRITTEN;
+    }
+    
+    if(job->entry.path == NULL) {
+        job->entry.path = countedStrdup(job->fileName);
+    }
+    job->entry.schemaHash = job->schemaHash;
+    job->entry.templateHash = job->tmpl->hash;
+    job->entry.outputHash = outputHash;
+}
+
+/* 64-bit FNV-1a, chained through hash so several inputs can be combined */
+uint64_t hashBytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    size_t i = 0;
+    while(i < length) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+        i++;
+    }
+    return hash;
+}
+
+/* Hashes the terminator too, so "ab" + "c" and "a" + "bc" differ */
+uint64_t hashString(uint64_t hash, const char *str) {
+    return hashBytes(hash, str, strlen(str) + 1);
+}
+
+uint64_t hashTable(const struct tableDef *def) {
+    uint64_t hash = hashString(FNV_OFFSET, def->name);
+    hash = hashString(hash, def->apiName);
+    hash = hashString(hash, def->key);
+    int i = 0;
+    while(i < def->columnCount) {
+        const struct column *col = &def->columns[i];
+        unsigned char flags[4] = { (unsigned char) col->type, (unsigned char) col->notNull,
+                                   (unsigned char) col->indexed, (unsigned char) col->foreignKey };
+        hash = hashString(hash, col->name);
+        hash = hashBytes(hash, flags, sizeof(flags));
+        i++;
+    }
+    i = 0;
+    while(i < def->linkCount) {
+        const struct link *link = &def->links[i];
+        hash = hashString(hash, link->join->name);
+        hash = hashString(hash, link->join->key);
+        hash = hashString(hash, link->near->name);
+        hash = hashString(hash, link->far->name);
+        hash = hashString(hash, link->nearKey->name);
+        hash = hashString(hash, link->other->name);
+        hash = hashBytes(hash, &link->far->type, sizeof(link->far->type));
+        i++;
+    }
+    hash = hashBytes(hash, &def->cacheSeconds, sizeof(def->cacheSeconds));
+    return hash;
+}
+
+/* Hashes the contents of fileName; returns -1 if it cannot be read */
+int hashFile(const char *fileName, uint64_t *hash) {
+    int fd = open(fileName, O_RDONLY);
+    if(fd == -1) {
+        return -1;
+    }
+    
+    char chunk[16384];
+    uint64_t result = FNV_OFFSET;
+    for(;;) {
+        ssize_t length = read(fd, chunk, sizeof(chunk));
+        if(length == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return -1;
+        }
+        if(length == 0) {
+            break;
+        }
+        result = hashBytes(result, chunk, (size_t) length);
+    }
+    close(fd);
+    *hash = result;
+    return 0;
+}
+
+/* A missing manifest is not an error, it just means nothing was generated yet */
+int loadManifest(const char *path, struct manifest *man) {
+    memset(man, 0, sizeof(struct manifest));
+    
+    FILE *file_ptr = fopen(path, "r");
+    if(file_ptr == NULL) {
+        if(errno == ENOENT) {
+            return 0;
+        }
+        printf("ERROR: Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    char line[MAX_FILE_STRING + 64];
+    int lineNumber = 0;
+    while(fgets(line, sizeof(line), file_ptr) != NULL) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+        
+        struct manifestEntry entry;
+        int pathStart = 0;
+        if(sscanf(line, "%" SCNx64 " %" SCNx64 " %" SCNx64 " %n", &entry.schemaHash,
+                  &entry.templateHash, &entry.outputHash, &pathStart) != 3 || line[pathStart] == '\0') {
+            printf("%s:%d: WARNING: ignoring malformed manifest line.\n", path, lineNumber);
+            continue;
+        }
+        entry.path = countedStrdup(line + pathStart);
+        addManifestEntry(man, &entry);
+    }
+    fclose(file_ptr);
+    
+    qsort(man->entries, man->count, sizeof(struct manifestEntry), compareManifestEntries);
+    return 0;
+}
+
+int saveManifest(const char *path, const struct manifest *man, struct arena *arena) {
+    struct outBuffer out;
+    bufInit(&out, arena);
+    
+    bufCat(&out, "# Written by ContextGenerator: schema hash, template hash, output hash, file\n", NULL);
+    int i = 0;
+    while(i < man->count) {
+        const struct manifestEntry *entry = &man->entries[i];
+        char hashes[64];
+        snprintf(hashes, sizeof(hashes), "%016" PRIx64 " %016" PRIx64 " %016" PRIx64 " ",
+                 entry->schemaHash, entry->templateHash, entry->outputHash);
+        bufCat(&out, hashes, entry->path, "\n", NULL);
+        i++;
+    }
+    
+    return commitFile(path, &out);
+}
+
+int compareManifestEntries(const void *a, const void *b) {
+    return strcmp(((const struct manifestEntry *) a)->path, ((const struct manifestEntry *) b)->path);
+}
+
+const struct manifestEntry *findManifestEntry(const struct manifest *man, const char *path) {
+    struct manifestEntry key;
+    key.path = (char *) path;
+    return (const struct manifestEntry *) bsearch(&key, man->entries, man->count,
+                                                  sizeof(struct manifestEntry), compareManifestEntries);
+}
+
+/* Takes ownership of entry->path */
+void addManifestEntry(struct manifest *man, const struct manifestEntry *entry) {
+    if(man->count == man->cap) {
+        man->cap = (man->cap == 0) ? 64 : man->cap * 2;
+        man->entries = (struct manifestEntry *) countedRealloc(man->entries, man->cap * sizeof(struct manifestEntry));
+    }
+    man->entries[man->count++] = *entry;
+}
+
+int manifestEqual(const struct manifest *a, const struct manifest *b) {
+    if(a->count != b->count) {
+        return 0;
+    }
+    int i = 0;
+    while(i < a->count) {
+        const struct manifestEntry *x = &a->entries[i];
+        const struct manifestEntry *y = &b->entries[i];
+        if(strcmp(x->path, y->path) != 0 || x->schemaHash != y->schemaHash
+           || x->templateHash != y->templateHash || x->outputHash != y->outputHash) {
+            return 0;
+        }
+        i++;
+    }
+    return 1;
+}
+
+void freeManifest(struct manifest *man) {
+    int i = 0;
+    while(i < man->count) {
+        free(man->entries[i].path);
+        i++;
+    }
+    free(man->entries);
+    memset(man, 0, sizeof(struct manifest));
+}
+
+/* Renders one template for one table and hands the result to finishFile */
+void generateFile(struct genJob *job) {
+    struct outBuffer path;
+    bufInit(&path, job->arena);
+    renderTemplate(&job->tmpl->path, job->tables, job->tableCount, &path);
+    bufAppend(&path, "", 1);
+    if(benchTables > 0) {
+        /* Every file is written the way a first run or --force writes it, but under the scratch directory */
+        struct outBuffer out;
+        bufInit(&out, job->arena);
+        renderTemplate(&job->tmpl->body, job->tables, job->tableCount, &out);
+        if(joinStrings(job->fileName, sizeof(job->fileName), benchDir, "/", path.data, NULL) != 0
+           || makeParents(job->fileName) != 0 || commitFile(job->fileName, &out) != 0) {
+            job->status = FILE_FAILED;
+            return;
+        }
+        __atomic_fetch_add(&renderedFiles, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&renderedBytes, out.length, __ATOMIC_RELAXED);
+        job->status = FILE_WRITTEN;
+        return;
+    }
+    if(!beginFile(job, path.data)) {
+        return;
+    }
+    
+    struct outBuffer out;
+    bufInit(&out, job->arena);
+    renderTemplate(&job->tmpl->body, job->tables, job->tableCount, &out);
+    
+    finishFile(job, &out);
+}
+
+/* Templates */
+
+/* Where a name may appear: anywhere, or only inside the loops it names */
+enum templateScope {
+    SCOPE_ANY = 0,
+    SCOPE_TABLE = 1,
+    SCOPE_FIELD = 2,
+    SCOPE_LINK = 4
+};
+
+struct templateName {
+    const char *name;
+    int code;
+    enum templateScope scope;
+};
+
+static const struct templateName templateVars[] = {
+    { "Table", VAR_TABLE, SCOPE_TABLE },
+    { "Api", VAR_API, SCOPE_TABLE },
+    { "Key", VAR_KEY, SCOPE_TABLE },
+    { "KeyType", VAR_KEY_TYPE, SCOPE_TABLE },
+    { "PageSize", VAR_PAGE_SIZE, SCOPE_ANY },
+    { "Context", VAR_CONTEXT, SCOPE_TABLE },
+    { "SharedContext", VAR_SHARED_CONTEXT, SCOPE_ANY },
+    { "CacheSeconds", VAR_CACHE_SECONDS, SCOPE_TABLE },
+    { "Await", VAR_AWAIT, SCOPE_ANY },
+    { "Async", VAR_ASYNC, SCOPE_ANY },
+    { "Token", VAR_TOKEN, SCOPE_ANY },
+    { "Field", VAR_FIELD, SCOPE_FIELD },
+    { "Type", VAR_TYPE, SCOPE_FIELD },
+    { "Join", VAR_JOIN, SCOPE_LINK },
+    { "JoinKey", VAR_JOIN_KEY, SCOPE_LINK },
+    { "Near", VAR_NEAR, SCOPE_LINK },
+    { "NearKey", VAR_NEAR_KEY, SCOPE_LINK },
+    { "Far", VAR_FAR, SCOPE_LINK },
+    { "Other", VAR_OTHER, SCOPE_LINK },
+    { "Link", VAR_LINK, SCOPE_LINK },
+    { "LinkType", VAR_LINK_TYPE, SCOPE_LINK }
+};
+
+static const struct templateName templateConds[] = {
+    { "first", COND_FIRST, SCOPE_FIELD },
+    { "last", COND_LAST, SCOPE_FIELD },
+    { "key", COND_KEY, SCOPE_FIELD },
+    { "string", COND_STRING, SCOPE_FIELD },
+    { "int", COND_INT, SCOPE_FIELD },
+    { "long", COND_LONG, SCOPE_FIELD },
+    { "decimal", COND_DECIMAL, SCOPE_FIELD },
+    { "indexed", COND_INDEXED, SCOPE_FIELD },
+    { "foreignKey", COND_FOREIGN_KEY, SCOPE_FIELD },
+    { "paged", COND_PAGED, SCOPE_ANY },
+    { "stringKey", COND_STRING_KEY, SCOPE_TABLE },
+    { "linked", COND_LINKED, SCOPE_TABLE },
+    { "cached", COND_CACHED, SCOPE_TABLE },
+    { "async", COND_ASYNC, SCOPE_ANY },
+    { "stream", COND_STREAM, SCOPE_ANY },
+    { "sparse", COND_SPARSE, SCOPE_ANY },
+    { "metrics", COND_METRICS, SCOPE_ANY }
+};
+
+static const struct templateName *findTemplateName(const struct templateName *names, size_t count,
+                                                   const char *name, size_t length) {
+    size_t i = 0;
+    while(i < count) {
+        if(strlen(names[i].name) == length && strncmp(names[i].name, name, length) == 0) {
+            return &names[i];
+        }
+        i++;
+    }
+    return NULL;
+}
+
+static int templateLine(const char *src, const char *pos) {
+    int line = 1;
+    while(src < pos) {
+        if(*src++ == '\n') {
+            line++;
+        }
+    }
+    return line;
+}
+
+static struct templateOp *addTemplateOp(struct templateProgram *prog, enum templateOpCode code, int arg) {
+    if(prog->count == prog->cap) {
+        prog->cap = (prog->cap == 0) ? 32 : prog->cap * 2;
+        prog->ops = (struct templateOp *) countedRealloc(prog->ops, prog->cap * sizeof(struct templateOp));
+    }
+    struct templateOp *op = &prog->ops[prog->count++];
+    memset(op, 0, sizeof(struct templateOp));
+    op->code = code;
+    op->arg = arg;
+    return op;
+}
+
+/*
+ Maps dir/spec->file and compiles it along with the output path. The
+ mapping stays in place because OP_TEXT spans point straight into it.
+ */
+int loadTemplate(const char *dir, const struct templateSpec *spec, struct template *tmpl) {
+    memset(tmpl, 0, sizeof(struct template));
+    tmpl->file = spec->file;
+    
+    char fileName[MAX_FILE_STRING];
+    if(joinStrings(fileName, sizeof(fileName), dir, "/", spec->file, NULL) != 0) {
+        return -1;
+    }
+    
+    int fd = open(fileName, O_RDONLY);
+    struct stat info;
+    if(fd == -1 || fstat(fd, &info) != 0) {
+        printf("ERROR: Could not open template %s: %s\n", fileName, strerror(errno));
+        if(fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    
+    tmpl->size = (size_t) info.st_size;
+    if(tmpl->size > 0) {
+        void *map = mmap(NULL, tmpl->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map == MAP_FAILED) {
+            printf("ERROR: Could not map template %s: %s\n", fileName, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        tmpl->source = (char *) map;
+    }
+    close(fd);
+    
+    const char *path = specPath(spec);
+    if(compileTemplate(fileName, tmpl->source, tmpl->size, spec->perSchema, &tmpl->body) != 0
+       || compileTemplate(spec->file, path, strlen(path), spec->perSchema && path == spec->path, &tmpl->path) != 0) {
+        return -1;
+    }
+    
+    /* The generator version and the options the templates can see are part of the hash, so changing them regenerates */
+    uint64_t hash = hashString(hashString(hashString(FNV_OFFSET, GENERATOR_VERSION), pageSizeText), sharedContext);
+    hash = hashBytes(hash, &asyncMode, sizeof(asyncMode));
+    hash = hashBytes(hash, &streamMode, sizeof(streamMode));
+    hash = hashBytes(hash, &sparseMode, sizeof(sparseMode));
+    hash = hashBytes(hash, &metricsMode, sizeof(metricsMode));
+    tmpl->hash = hashBytes(hashString(hash, path), tmpl->source, tmpl->size);
+    return 0;
+}
+
+/* Compiles src into prog, reporting errors against file */
+int compileTemplate(const char *file, const char *src, size_t size, int perSchema, struct templateProgram *prog) {
+    const char *pos = src;
+    const char *end = src + size;
+    
+    /* Open sections: index of the opening op and the name that closes it */
+    int stack[MAX_TEMPLATE_DEPTH];
+    const char *stackName[MAX_TEMPLATE_DEPTH];
+    size_t stackLength[MAX_TEMPLATE_DEPTH];
+    int depth = 0;
+    int scope = perSchema ? SCOPE_ANY : SCOPE_TABLE;
+    
+    while(pos < end) {
+        const char *tag = pos;
+        while(tag < end - 1 && !(tag[0] == '{' && tag[1] == '{')) {
+            tag++;
+        }
+        if(tag >= end - 1) {
+            struct templateOp *op = addTemplateOp(prog, OP_TEXT, 0);
+            op->text = pos;
+            op->length = (size_t) (end - pos);
+            break;
+        }
+        
+        const char *close = tag + 2;
+        while(close < end - 1 && !(close[0] == '}' && close[1] == '}')) {
+            close++;
+        }
+        if(close >= end - 1) {
+            printf("%s:%d: ERROR: unterminated template tag.\n", file, templateLine(src, tag));
+            return -1;
+        }
+        
+        const char *name = tag + 2;
+        const char *nameEnd = close;
+        while(name < nameEnd && isspace((unsigned char) *name)) {
+            name++;
+        }
+        while(nameEnd > name && isspace((unsigned char) nameEnd[-1])) {
+            nameEnd--;
+        }
+        char sigil = (name < nameEnd && (*name == '#' || *name == '^' || *name == '/')) ? *name : '\0';
+        if(sigil != '\0') {
+            name++;
+        }
+        size_t length = (size_t) (nameEnd - name);
+        
+        /* A section tag alone on its line takes the line with it */
+        const char *textEnd = tag;
+        const char *next = close + 2;
+        if(sigil != '\0') {
+            const char *lineStart = tag;
+            while(lineStart > src && (lineStart[-1] == ' ' || lineStart[-1] == '\t')) {
+                lineStart--;
+            }
+            const char *lineEnd = next;
+            while(lineEnd < end && (*lineEnd == ' ' || *lineEnd == '\t' || *lineEnd == '\r')) {
+                lineEnd++;
+            }
+            if((lineStart == src || lineStart[-1] == '\n') && (lineEnd == end || *lineEnd == '\n')) {
+                textEnd = lineStart;
+                next = (lineEnd < end) ? lineEnd + 1 : end;
+            }
+        }
+        if(textEnd > pos) {
+            struct templateOp *op = addTemplateOp(prog, OP_TEXT, 0);
+            op->text = pos;
+            op->length = (size_t) (textEnd - pos);
+        }
+        pos = next;
+        
+        if(sigil == '/') {
+            if(depth == 0 || stackLength[depth - 1] != length || strncmp(stackName[depth - 1], name, length) != 0) {
+                printf("%s:%d: ERROR: unexpected {{/%.*s}}.\n", file, templateLine(src, tag), (int) length, name);
+                return -1;
+            }
+            depth--;
+            int start = stack[depth];
+            if(prog->ops[start].code == OP_FIELDS) {
+                addTemplateOp(prog, OP_NEXT, 0)->jump = start + 1;
+                scope &= ~SCOPE_FIELD;
+            } else if(prog->ops[start].code == OP_LINKS) {
+                addTemplateOp(prog, OP_NEXT_LINK, 0)->jump = start + 1;
+                scope &= ~SCOPE_LINK;
+            } else if(prog->ops[start].code == OP_TABLES) {
+                addTemplateOp(prog, OP_NEXT_TABLE, 0)->jump = start + 1;
+                scope = SCOPE_ANY;
+            }
+            prog->ops[start].jump = prog->count;
+            continue;
+        }
+        
+        if(sigil != '\0' && depth == MAX_TEMPLATE_DEPTH) {
+            printf("%s:%d: ERROR: sections nested too deeply.\n", file, templateLine(src, tag));
+            return -1;
+        }
+        
+        if(sigil == '#' && length == 6 && strncmp(name, "fields", 6) == 0) {
+            if((scope & SCOPE_TABLE) == 0 || (scope & SCOPE_FIELD) != 0) {
+                printf("%s:%d: ERROR: {{#fields}} is only valid inside a table and cannot be nested.\n", file,
+                       templateLine(src, tag));
+                return -1;
+            }
+            stack[depth] = prog->count;
+            stackName[depth] = name;
+            stackLength[depth] = length;
+            depth++;
+            addTemplateOp(prog, OP_FIELDS, 0);
+            scope |= SCOPE_FIELD;
+            continue;
+        }
+        
+        if(sigil == '#' && length == 5 && strncmp(name, "links", 5) == 0) {
+            if(scope != SCOPE_TABLE) {
+                printf("%s:%d: ERROR: {{#links}} is only valid directly inside a table.\n", file, templateLine(src, tag));
+                return -1;
+            }
+            stack[depth] = prog->count;
+            stackName[depth] = name;
+            stackLength[depth] = length;
+            depth++;
+            addTemplateOp(prog, OP_LINKS, 0);
+            scope |= SCOPE_LINK;
+            continue;
+        }
+        
+        if(sigil == '#' && length == 6 && strncmp(name, "tables", 6) == 0) {
+            if(scope != SCOPE_ANY) {
+                printf("%s:%d: ERROR: {{#tables}} is only valid at the top of a schema template.\n", file, templateLine(src, tag));
+                return -1;
+            }
+            stack[depth] = prog->count;
+            stackName[depth] = name;
+            stackLength[depth] = length;
+            depth++;
+            addTemplateOp(prog, OP_TABLES, 0);
+            scope = SCOPE_TABLE;
+            continue;
+        }
+        
+        const struct templateName *found;
+        if(sigil == '\0') {
+            found = findTemplateName(templateVars, sizeof(templateVars) / sizeof(templateVars[0]), name, length);
+        } else {
+            found = findTemplateName(templateConds, sizeof(templateConds) / sizeof(templateConds[0]), name, length);
+        }
+        if(found == NULL) {
+            printf("%s:%d: ERROR: unknown template name %.*s.\n", file, templateLine(src, tag), (int) length, name);
+            return -1;
+        }
+        if((found->scope & ~scope) != 0) {
+            printf("%s:%d: ERROR: %.*s is only valid inside {{#%s}}.\n", file, templateLine(src, tag), (int) length, name,
+                   (found->scope == SCOPE_FIELD) ? "fields" : (found->scope == SCOPE_LINK) ? "links" : "tables");
+            return -1;
+        }
+        
+        if(sigil == '\0') {
+            addTemplateOp(prog, OP_VAR, found->code);
+        } else {
+            stack[depth] = prog->count;
+            stackName[depth] = name;
+            stackLength[depth] = length;
+            depth++;
+            addTemplateOp(prog, (sigil == '#') ? OP_IF : OP_UNLESS, found->code);
+        }
+    }
+    
+    if(depth > 0) {
+        printf("%s: ERROR: section %.*s is never closed.\n", file, (int) stackLength[depth - 1], stackName[depth - 1]);
+        return -1;
+    }
+    return 0;
+}
+
+/* The column named by the key, or NULL when -k names something that is not a field */
+static const struct column *keyColumn(const struct tableDef *def) {
+    int i = 0;
+    while(i < def->columnCount) {
+        if(strcmp(def->columns[i].name, def->key) == 0) {
+            return &def->columns[i];
+        }
+        i++;
+    }
+    return NULL;
+}
+
+static const char *templateValue(int var, const struct tableDef *def, int index, int link) {
+    const struct column *key;
+    switch (var) {
+        case VAR_JOIN:
+            return def->links[link].join->name;
+        case VAR_JOIN_KEY:
+            return def->links[link].join->key;
+        case VAR_NEAR:
+            return def->links[link].near->name;
+        case VAR_NEAR_KEY:
+            return def->links[link].nearKey->name;
+        case VAR_FAR:
+            return def->links[link].far->name;
+        case VAR_OTHER:
+            return def->links[link].other->name;
+        case VAR_LINK:
+            return def->links[link].name;
+        case VAR_LINK_TYPE:
+            return fieldTypeName(def->links[link].far->type);
+        case VAR_CONTEXT:
+            /* Per-table contexts are named after the table, so only the shared name is whole */
+            return (sharedContext[0] != '\0') ? sharedContext : def->name;
+        case VAR_SHARED_CONTEXT:
+            return sharedContext;
+        case VAR_CACHE_SECONDS:
+            return def->cacheText;
+        case VAR_AWAIT:
+            return asyncMode ? "await " : "";
+        case VAR_ASYNC:
+            return asyncMode ? "Async" : "";
+        case VAR_TOKEN:
+            return asyncMode ? "cancellationToken" : "";
+        case VAR_TABLE:
+            return def->name;
+        case VAR_API:
+            return def->apiName;
+        case VAR_KEY:
+            return def->key;
+        case VAR_KEY_TYPE:
+            key = keyColumn(def);
+            return fieldTypeName(key ? key->type : FIELD_INT);
+        case VAR_PAGE_SIZE:
+            return pageSizeText;
+        case VAR_FIELD:
+            return def->columns[index].name;
+        case VAR_TYPE:
+        default:
+            return fieldTypeName(def->columns[index].type);
+    }
+}
+
+static int templateTest(int cond, const struct tableDef *def, int index) {
+    const struct column *key;
+    switch (cond) {
+        case COND_PAGED:
+            return pageSize > 0;
+        case COND_ASYNC:
+            return asyncMode;
+        case COND_STREAM:
+            return streamMode;
+        case COND_SPARSE:
+            return sparseMode;
+        case COND_METRICS:
+            return metricsMode;
+        case COND_STRING_KEY:
+            key = keyColumn(def);
+            return key != NULL && key->type == FIELD_STRING;
+        case COND_LINKED:
+            return def->linkCount > 0;
+        case COND_CACHED:
+            return def->cacheSeconds > 0;
+        case COND_FIRST:
+            return index == 0;
+        case COND_LAST:
+            return index == def->columnCount - 1;
+        case COND_KEY:
+            return strcmp(def->columns[index].name, def->key) == 0;
+        case COND_STRING:
+            return def->columns[index].type == FIELD_STRING;
+        case COND_INT:
+            return def->columns[index].type == FIELD_INT;
+        case COND_LONG:
+            return def->columns[index].type == FIELD_LONG;
+        case COND_DECIMAL:
+            return def->columns[index].type == FIELD_DECIMAL;
+        case COND_INDEXED:
+            return def->columns[index].indexed && strcmp(def->columns[index].name, def->key) != 0;
+        case COND_FOREIGN_KEY:
+        default:
+            return def->columns[index].foreignKey;
+    }
+}
+
+/* Table templates are rendered with a single table, which is current throughout */
+void renderTemplate(const struct templateProgram *prog, const struct tableDef *tables, int tableCount,
+                    struct outBuffer *out) {
+    const struct tableDef *def = tables;
+    int table = 0;
+    int index = 0;
+    int link = 0;
+    int pc = 0;
+    while(pc < prog->count) {
+        const struct templateOp *op = &prog->ops[pc];
+        switch (op->code) {
+            case OP_TEXT:
+                bufAppend(out, op->text, op->length);
+                pc++;
+                break;
+            case OP_VAR: {
+                const char *value = templateValue(op->arg, def, index, link);
+                bufAppend(out, value, strlen(value));
+                if(op->arg == VAR_CONTEXT && sharedContext[0] == '\0') {
+                    bufAppend(out, "Context", 7);
+                }
+                pc++;
+                break;
+            }
+            case OP_TABLES:
+                table = 0;
+                def = tables;
+                pc = (tableCount > 0) ? pc + 1 : op->jump;
+                break;
+            case OP_NEXT_TABLE:
+                table++;
+                def = &tables[table];
+                pc = (table < tableCount) ? op->jump : pc + 1;
+                break;
+            case OP_FIELDS:
+                index = 0;
+                pc = (def->columnCount > 0) ? pc + 1 : op->jump;
+                break;
+            case OP_NEXT:
+                index++;
+                pc = (index < def->columnCount) ? op->jump : pc + 1;
+                break;
+            case OP_LINKS:
+                link = 0;
+                pc = (def->linkCount > 0) ? pc + 1 : op->jump;
+                break;
+            case OP_NEXT_LINK:
+                link++;
+                pc = (link < def->linkCount) ? op->jump : pc + 1;
+                break;
+            case OP_IF:
+            case OP_UNLESS:
+                if(templateTest(op->arg, def, index) == (op->code == OP_IF)) {
+                    pc++;
+                } else {
+                    pc = op->jump;
+                }
+                break;
+        }
+    }
+}
+
+void freeTemplate(struct template *tmpl) {
+    if(tmpl->source != NULL) {
+        munmap(tmpl->source, tmpl->size);
+    }
+    free(tmpl->path.ops);
+    free(tmpl->body.ops);
+    memset(tmpl, 0, sizeof(struct template));
+}
+
+void getCommandLine(int argc, char **argv, struct tableDef *def) {
+    
+    static const struct option longOptions[] = {
+        { "force", no_argument, NULL, 'F' },
+        { "skip-existing", no_argument, NULL, 'K' },
+        { "check", no_argument, NULL, 'C' },
+        { "async", no_argument, NULL, 'A' },
+        { "stream", no_argument, NULL, 'W' },
+        { "sparse", no_argument, NULL, 'Q' },
+        { "metrics", no_argument, NULL, 'M' },
+        { "harness", no_argument, NULL, 'H' },
+        { "bench", required_argument, NULL, 'B' },
+        { NULL, 0, NULL, 0 }
+    };
+    
+    int c;
+    extern char *optarg;
+    
+    while((c = getopt_long(argc, argv, "a:t:k:s:i:l:d:S:j:T:p:x:f:e:c:r:", longOptions, NULL)) != -1) {
+        switch (c) {
+            case 't':
+                free(def->name);
+                def->name = countedStrdup(optarg);
+                break;
+            case 'a':
+                free(def->apiName);
+                def->apiName = countedStrdup(optarg);
+                break;
+            case 'k':
+                free(def->key);
+                def->key = countedStrdup(optarg);
+                break;
+            case 's':
+                addColumn(def, optarg, FIELD_STRING);
+                break;
+            case 'i':
+                addColumn(def, optarg, FIELD_INT);
+                break;
+            case 'l':
+                addColumn(def, optarg, FIELD_LONG);
+                break;
+            case 'd':
+                addColumn(def, optarg, FIELD_DECIMAL);
+                break;
+            case 'S':
+                schemaFiles = (const char **) countedRealloc(schemaFiles, (schemaIndex + 1) * sizeof(const char *));
+                schemaFiles[schemaIndex++] = optarg;
+                break;
+            case 'j':
+                jobCount = atoi(optarg);
+                if(jobCount <= 0) {
+                    jobCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+                }
+                break;
+            case 'T':
+                templateDir = optarg;
+                break;
+            case 'x':
+                addAnnotation(optarg, 0);
+                break;
+            case 'f':
+                addAnnotation(optarg, 1);
+                break;
+            case 'e':
+                addCache(optarg);
+                break;
+            case 'p':
+                pageSize = atoi(optarg);
+                if(pageSize < 0) {
+                    pageSize = 0;
+                }
+                snprintf(pageSizeText, sizeof(pageSizeText), "%d", pageSize);
+                break;
+            case 'r':
+                addRelation(optarg);
+                break;
+            case 'c':
+                if(joinStrings(sharedContext, sizeof(sharedContext), optarg, "Context", NULL) != 0) {
+                    exit(1);
+                }
+                break;
+            case 'F':
+                overwriteMode = OVERWRITE_FORCE;
+                break;
+            case 'K':
+                overwriteMode = OVERWRITE_SKIP_EXISTING;
+                break;
+            case 'C':
+                overwriteMode = OVERWRITE_CHECK;
+                break;
+            case 'A':
+                asyncMode = 1;
+                break;
+            case 'W':
+                streamMode = 1;
+                break;
+            case 'Q':
+                sparseMode = 1;
+                break;
+            case 'M':
+                metricsMode = 1;
+                break;
+            case 'H':
+                harnessMode = 1;
+                break;
+            case 'B':
+                benchRuns = 1;
+                if(sscanf(optarg, "%d.%d.%d", &benchTables, &benchColumns, &benchRuns) < 2
+                   || benchTables <= 0 || benchColumns <= 0 || benchRuns <= 0) {
+                    printf("ERROR: --bench takes Tables.Columns or Tables.Columns.Runs, not %s.\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                printf("Generator command line options:\n");
+                printf(" -t \t enter name of the table (required unless -S is used)\n");
+                printf(" -a \t enter name of API call (default is table name)\n");
+                printf(" -k \t enter name of the primary key (default is ID)\n");
+                printf(" -s \t enter string field for model\n");
+                printf(" -i \t enter integer field for model\n");
+                printf(" -l \t enter 64-bit integer field for model\n");
+                printf(" -d \t enter decimal field for model\n");
+                printf(" -S \t enter SQL schema file to generate every table from\n");
+                printf(" -j \t enter number of generator threads (0 uses every core)\n");
+                printf(" -T \t enter directory holding the templates (default is %s)\n", TEMPLATE_DIR);
+                printf(" -x \t enter Table.Column (or Column with -t) to index\n");
+                printf(" -f \t enter Table.Column (or Column with -t) that is a foreign key, which is indexed too\n");
+                printf(" -e \t enter Table.Seconds (or Seconds with -t) to serve a small table's reads from memory for that long\n");
+                printf(" -r \t enter JoinTable.Column.Column to query the two referenced tables through the join table\n");
+                printf(" -p \t enter maximum page size to emit keyset paginated list endpoints\n");
+                printf(" -c \t enter name of a single pooled context to use instead of one context per table (needs -S)\n");
+                printf(" --async \t emit async repositories and controllers that take the request's cancellation token\n");
+                printf(" --stream \t emit unpaged list endpoints that write rows to the response as they are read\n");
+                printf(" --metrics \t emit metered repositories, SaveChanges counters and an api/metrics endpoint (the endpoint needs -S)\n");
+                printf(" --harness \t emit the Ario.Bench cases that time every generated repository against SQLite (needs -S)\n");
+                printf(" --sparse \t emit a ?fields= parameter on display list endpoints that limits the columns read and returned\n");
+                printf(" --force \t overwrite files even if they were edited after generation\n");
+                printf(" --skip-existing \t only write files that do not exist yet\n");
+                printf(" --check \t write nothing, list out of date files and fail if there are any\n");
+                printf(" --bench \t enter Tables.Columns[.Runs] to time rendering a made up schema of that size, writing nothing\n");
+                exit(1);
+        }
+    }
+}
+
+/* SQL schema ingest */
+
+enum tokenType {
+    TOK_END,
+    TOK_IDENT,
+    TOK_NUMBER,
+    TOK_STRING,
+    TOK_PUNCT
+};
+
+struct token {
+    enum tokenType type;
+    const char *start;
+    int length;
+    int line;
+};
+
+struct parser {
+    const char *path;
+    const char *cur;
+    const char *end;
+    int line;
+    struct token tok;
+};
+
+static int isIdentChar(char c) {
+    return isalnum((unsigned char) c) || c == '_' || c == '@' || c == '#' || c == '$';
+}
+
+static void advance(struct parser *p) {
+    struct token *tok = &p->tok;
+    
+    for(;;) {
+        while(p->cur < p->end && isspace((unsigned char) *p->cur)) {
+            if(*p->cur == '\n') {
+                p->line++;
+            }
+            p->cur++;
+        }
+        if(p->end - p->cur >= 2 && p->cur[0] == '-' && p->cur[1] == '-') {
+            while(p->cur < p->end && *p->cur != '\n') {
+                p->cur++;
+            }
+        } else if(p->end - p->cur >= 2 && p->cur[0] == '/' && p->cur[1] == '*') {
+            p->cur += 2;
+            while(p->cur < p->end && !(p->end - p->cur >= 2 && p->cur[0] == '*' && p->cur[1] == '/')) {
+                if(*p->cur == '\n') {
+                    p->line++;
+                }
+                p->cur++;
+            }
+            p->cur = (p->cur < p->end) ? p->cur + 2 : p->end;
+        } else {
+            break;
+        }
+    }
+    
+    tok->line = p->line;
+    if(p->cur >= p->end) {
+        tok->type = TOK_END;
+        tok->start = p->end;
+        tok->length = 0;
+        return;
+    }
+    
+    char c = *p->cur;
+    if((c == 'N' || c == 'n') && p->end - p->cur >= 2 && p->cur[1] == '\'') {
+        p->cur++;
+        c = '\'';
+    }
+    
+    if(c == '\'') {
+        /* String literals are skipped as a whole so their contents never parse as DDL */
+        tok->type = TOK_STRING;
+        tok->start = ++p->cur;
+        while(p->cur < p->end) {
+            if(*p->cur == '\'') {
+                if(p->end - p->cur >= 2 && p->cur[1] == '\'') {
+                    p->cur += 2;
+                    continue;
+                }
+                break;
+            }
+            if(*p->cur == '\n') {
+                p->line++;
+            }
+            p->cur++;
+        }
+        tok->length = (int) (p->cur - tok->start);
+        if(p->cur < p->end) {
+            p->cur++;
+        }
+    } else if(c == '[' || c == '"') {
+        char close = (c == '[') ? ']' : '"';
+        tok->type = TOK_IDENT;
+        tok->start = ++p->cur;
+        while(p->cur < p->end && *p->cur != close) {
+            p->cur++;
+        }
+        tok->length = (int) (p->cur - tok->start);
+        if(p->cur < p->end) {
+            p->cur++;
+        }
+    } else if(isdigit((unsigned char) c)) {
+        tok->type = TOK_NUMBER;
+        tok->start = p->cur;
+        while(p->cur < p->end && (isdigit((unsigned char) *p->cur) || *p->cur == '.')) {
+            p->cur++;
+        }
+        tok->length = (int) (p->cur - tok->start);
+    } else if(isIdentChar(c)) {
+        tok->type = TOK_IDENT;
+        tok->start = p->cur;
+        while(p->cur < p->end && isIdentChar(*p->cur)) {
+            p->cur++;
+        }
+        tok->length = (int) (p->cur - tok->start);
+    } else {
+        tok->type = TOK_PUNCT;
+        tok->start = p->cur++;
+        tok->length = 1;
+    }
+}
+
+static int tokenIs(const struct token *tok, const char *word) {
+    if(tok->type != TOK_IDENT || (int) strlen(word) != tok->length) {
+        return 0;
+    }
+    return strncasecmp(tok->start, word, tok->length) == 0;
+}
+
+static int tokenIsPunct(const struct token *tok, char c) {
+    return tok->type == TOK_PUNCT && tok->start[0] == c;
+}
+
+/* Consumes tokens up to the ',' or ')' that ends the current table element */
+static void skipElement(struct parser *p) {
+    int depth = 0;
+    while(p->tok.type != TOK_END) {
+        if(tokenIsPunct(&p->tok, '(')) {
+            depth++;
+        } else if(tokenIsPunct(&p->tok, ')')) {
+            if(depth == 0) {
+                return;
+            }
+            depth--;
+        } else if(tokenIsPunct(&p->tok, ',') && depth == 0) {
+            return;
+        }
+        advance(p);
+    }
+}
+
+static int mapColumnType(const struct token *type, enum fieldType *out) {
+    if(tokenIs(type, "int")) {
+        *out = FIELD_INT;
+    } else if(tokenIs(type, "bigint")) {
+        *out = FIELD_LONG;
+    } else if(tokenIs(type, "varchar") || tokenIs(type, "nvarchar") || tokenIs(type, "char")
+              || tokenIs(type, "nchar") || tokenIs(type, "text") || tokenIs(type, "ntext")) {
+        *out = FIELD_STRING;
+    } else if(tokenIs(type, "decimal") || tokenIs(type, "numeric") || tokenIs(type, "money")
+              || tokenIs(type, "smallmoney")) {
+        *out = FIELD_DECIMAL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+struct column *addColumn(struct tableDef *def, const char *name, enum fieldType type) {
+    if(def->columnCount == def->columnCap) {
+        def->columnCap = (def->columnCap == 0) ? 8 : def->columnCap * 2;
+        def->columns = (struct column *) countedRealloc(def->columns, def->columnCap * sizeof(struct column));
+    }
+    struct column *col = &def->columns[def->columnCount++];
+    memset(col, 0, sizeof(struct column));
+    col->name = countedStrdup(name);
+    col->type = type;
+    return col;
+}
+
+/*
+ Puts -t columns in the order the generator has always written them:
+ ints, then longs, then strings, then decimals, each in command line
+ order. Schema tables keep the order of their CREATE TABLE block.
+ */
+void groupColumns(struct tableDef *def) {
+    int i = 1;
+    while(i < def->columnCount) {
+        struct column col = def->columns[i];
+        int j = i;
+        while(j > 0 && def->columns[j - 1].type > col.type) {
+            def->columns[j] = def->columns[j - 1];
+            j--;
+        }
+        def->columns[j] = col;
+        i++;
+    }
+}
+
+static struct column *findColumn(struct tableDef *def, const char *name, int length) {
+    int i = 0;
+    while(i < def->columnCount) {
+        if((int) strlen(def->columns[i].name) == length && strncasecmp(def->columns[i].name, name, length) == 0) {
+            return &def->columns[i];
+        }
+        i++;
+    }
+    return NULL;
+}
+
+void addAnnotation(const char *target, int foreignKey) {
+    annotations = (struct annotation *) countedRealloc(annotations, (annotationCount + 1) * sizeof(struct annotation));
+    annotations[annotationCount].target = target;
+    annotations[annotationCount].foreignKey = foreignKey;
+    annotationCount++;
+}
+
+/* Marks the columns named by -x and -f; a bare column name needs a single table */
+void applyAnnotations(struct tableDef *tables, int tableCount) {
+    int i = 0;
+    while(i < annotationCount) {
+        const char *target = annotations[i].target;
+        const char *dot = strrchr(target, '.');
+        struct tableDef *def = NULL;
+        if(dot == NULL) {
+            def = (tableCount == 1) ? &tables[0] : NULL;
+        } else {
+            int t = 0;
+            while(t < tableCount && def == NULL) {
+                if((int) strlen(tables[t].name) == dot - target && strncasecmp(tables[t].name, target, dot - target) == 0) {
+                    def = &tables[t];
+                }
+                t++;
+            }
+        }
+        
+        const char *name = (dot == NULL) ? target : dot + 1;
+        struct column *col = (def != NULL) ? findColumn(def, name, (int) strlen(name)) : NULL;
+        if(col == NULL) {
+            printf("WARNING: no column %s to index.\n", target);
+        } else {
+            col->indexed = 1;
+            col->foreignKey |= annotations[i].foreignKey;
+        }
+        i++;
+    }
+}
+
+void addRelation(const char *target) {
+    relations = (const char **) countedRealloc(relations, (relationCount + 1) * sizeof(const char *));
+    relations[relationCount++] = target;
+}
+
+static struct tableDef *findTable(struct tableDef *tables, int tableCount, const char *name, int length) {
+    int t = 0;
+    while(t < tableCount) {
+        if((int) strlen(tables[t].name) == length && strncasecmp(tables[t].name, name, length) == 0) {
+            return &tables[t];
+        }
+        t++;
+    }
+    return NULL;
+}
+
+void addCache(const char *target) {
+    caches = (const char **) countedRealloc(caches, (cacheCount + 1) * sizeof(const char *));
+    caches[cacheCount++] = target;
+}
+
+/* Sets the cache lifetime of the tables named by -e; a bare number needs a single table */
+void applyCaches(struct tableDef *tables, int tableCount) {
+    int i = 0;
+    while(i < cacheCount) {
+        const char *target = caches[i];
+        const char *dot = strrchr(target, '.');
+        struct tableDef *def = NULL;
+        if(dot == NULL) {
+            def = (tableCount == 1) ? &tables[0] : NULL;
+        } else {
+            def = findTable(tables, tableCount, target, (int) (dot - target));
+        }
+        
+        const char *seconds = (dot == NULL) ? target : dot + 1;
+        char *end;
+        long ttl = strtol(seconds, &end, 10);
+        if(def == NULL) {
+            printf("WARNING: no table %s to cache.\n", target);
+        } else if(end == seconds || *end != '\0' || ttl <= 0 || ttl > 86400) {
+            printf("WARNING: cache time in %s should be 1 to 86400 seconds.\n", target);
+        } else {
+            def->cacheSeconds = (int) ttl;
+            snprintf(def->cacheText, sizeof(def->cacheText), "%d", def->cacheSeconds);
+        }
+        i++;
+    }
+}
+
+/* The table a join column references and the column there it matches, or -1 */
+static int resolveReference(struct tableDef *tables, int tableCount, const struct tableDef *join,
+                            const struct column *col, struct tableDef **target, struct column **targetKey) {
+    if(col->refTable == NULL) {
+        printf("ERROR: %s.%s has no FOREIGN KEY ... REFERENCES in the schema.\n", join->name, col->name);
+        return -1;
+    }
+    *target = findTable(tables, tableCount, col->refTable, (int) strlen(col->refTable));
+    if(*target == NULL) {
+        printf("ERROR: %s.%s references %s, which is not in the schema.\n", join->name, col->name, col->refTable);
+        return -1;
+    }
+    const char *keyName = (col->refColumn != NULL) ? col->refColumn : (*target)->key;
+    *targetKey = findColumn(*target, keyName, (int) strlen(keyName));
+    if(*targetKey == NULL) {
+        printf("ERROR: %s.%s references %s.%s, which is not a column.\n", join->name, col->name, (*target)->name, keyName);
+        return -1;
+    }
+    if((*targetKey)->type != col->type) {
+        printf("ERROR: %s.%s and %s.%s have different types.\n", join->name, col->name, (*target)->name, (*targetKey)->name);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ Links def to other; the link is named after far without a trailing ID, so TeamID gives
+ GetNodesByTeam. Two links of one table with the same name would emit the same method
+ and route twice, so that is an error.
+ */
+static int addLink(struct tableDef *def, const struct tableDef *join, const struct column *near,
+                   const struct column *far, const struct column *nearKey, const struct tableDef *other) {
+    size_t length = strlen(far->name);
+    char *name;
+    if(length > 2 && strcasecmp(far->name + length - 2, "ID") == 0) {
+        name = countedStrndup(far->name, length - 2);
+    } else {
+        name = countedStrdup(other->name);
+    }
+    int l = 0;
+    while(l < def->linkCount) {
+        if(strcasecmp(def->links[l].name, name) == 0) {
+            printf("ERROR: %s.%s and %s.%s both link %s by %s, so its By%s methods and routes would clash.\n",
+                   def->links[l].join->name, def->links[l].far->name, join->name, far->name, def->name, name, name);
+            free(name);
+            return -1;
+        }
+        l++;
+    }
+    
+    def->links = (struct link *) countedRealloc(def->links, (def->linkCount + 1) * sizeof(struct link));
+    struct link *link = &def->links[def->linkCount++];
+    link->join = join;
+    link->near = near;
+    link->far = far;
+    link->nearKey = nearKey;
+    link->other = other;
+    link->name = name;
+    return 0;
+}
+
+/*
+ Resolves each -r JoinTable.Left.Right through the foreign keys of the
+ two columns and links the referenced tables to each other both ways.
+ The join columns are indexed, since every relationship query filters
+ on one and joins on the other.
+ */
+int applyRelations(struct tableDef *tables, int tableCount) {
+    int i = 0;
+    while(i < relationCount) {
+        const char *target = relations[i];
+        const char *first = strchr(target, '.');
+        const char *second = (first != NULL) ? strchr(first + 1, '.') : NULL;
+        if(second == NULL || strchr(second + 1, '.') != NULL) {
+            printf("ERROR: relationship %s should be JoinTable.Column.Column.\n", target);
+            return -1;
+        }
+        
+        struct tableDef *join = findTable(tables, tableCount, target, (int) (first - target));
+        if(join == NULL) {
+            printf("ERROR: no join table %.*s for relationship %s.\n", (int) (first - target), target, target);
+            return -1;
+        }
+        struct column *left = findColumn(join, first + 1, (int) (second - first - 1));
+        struct column *right = findColumn(join, second + 1, (int) strlen(second + 1));
+        if(left == NULL) {
+            printf("ERROR: no column %.*s in %s.\n", (int) (second - first - 1), first + 1, join->name);
+            return -1;
+        }
+        if(right == NULL) {
+            printf("ERROR: no column %s in %s.\n", second + 1, join->name);
+            return -1;
+        }
+        
+        struct tableDef *leftTable;
+        struct tableDef *rightTable;
+        struct column *leftKey;
+        struct column *rightKey;
+        if(resolveReference(tables, tableCount, join, left, &leftTable, &leftKey) != 0
+           || resolveReference(tables, tableCount, join, right, &rightTable, &rightKey) != 0) {
+            return -1;
+        }
+        if(leftTable == rightTable) {
+            printf("ERROR: relationship %s joins %s to itself, which is not supported.\n", target, leftTable->name);
+            return -1;
+        }
+        int l = 0;
+        while(l < leftTable->linkCount) {
+            if(leftTable->links[l].join == join) {
+                printf("ERROR: %s is declared as a relationship more than once.\n", join->name);
+                return -1;
+            }
+            l++;
+        }
+        
+        left->foreignKey = 1;
+        left->indexed = 1;
+        right->foreignKey = 1;
+        right->indexed = 1;
+        if(addLink(leftTable, join, left, right, leftKey, rightTable) != 0
+           || addLink(rightTable, join, right, left, rightKey, leftTable) != 0) {
+            return -1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+void freeTable(struct tableDef *def) {
+    int i = 0;
+    while(i < def->columnCount) {
+        free(def->columns[i].name);
+        free(def->columns[i].refTable);
+        free(def->columns[i].refColumn);
+        i++;
+    }
+    free(def->columns);
+    i = 0;
+    while(i < def->linkCount) {
+        free(def->links[i].name);
+        i++;
+    }
+    free(def->links);
+    free(def->name);
+    free(def->apiName);
+    free(def->key);
+}
+
+/* Reads the last part of a possibly qualified name such as db.dbo.Table */
+static struct token parseName(struct parser *p) {
+    struct token name = p->tok;
+    advance(p);
+    while(tokenIsPunct(&p->tok, '.')) {
+        advance(p);
+        name = p->tok;
+        advance(p);
+    }
+    return name;
+}
+
+/*
+ REFERENCES Table (a, b): records the target of each of the count local
+ columns, in order, and leaves the parser after the column list.
+ */
+static void parseReferences(struct parser *p, struct column **cols, int count) {
+    advance(p);
+    struct token table = parseName(p);
+    int i = 0;
+    while(i < count) {
+        if(cols[i] != NULL) {
+            cols[i]->foreignKey = 1;
+            cols[i]->indexed = 1;
+            free(cols[i]->refTable);
+            cols[i]->refTable = countedStrndup(table.start, table.length);
+        }
+        i++;
+    }
+    if(!tokenIsPunct(&p->tok, '(')) {
+        return;
+    }
+    advance(p);
+    i = 0;
+    while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, ')')) {
+        if(p->tok.type == TOK_IDENT && i < count) {
+            if(cols[i] != NULL) {
+                free(cols[i]->refColumn);
+                cols[i]->refColumn = countedStrndup(p->tok.start, p->tok.length);
+            }
+            i++;
+        }
+        advance(p);
+    }
+    advance(p);
+}
+
+/* FOREIGN KEY (a, b) REFERENCES ...: marks the local columns and what they point at */
+static void parseForeignKey(struct parser *p, struct tableDef *def) {
+    struct column *cols[MAX_KEY_COLUMNS];
+    int count = 0;
+    while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, '(')) {
+        advance(p);
+    }
+    advance(p);
+    while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, ')')) {
+        if(p->tok.type == TOK_IDENT) {
+            struct column *col = findColumn(def, p->tok.start, p->tok.length);
+            if(col != NULL) {
+                col->foreignKey = 1;
+                col->indexed = 1;
+            }
+            if(count < MAX_KEY_COLUMNS) {
+                cols[count++] = col;
+            }
+        }
+        advance(p);
+    }
+    advance(p);
+    if(tokenIs(&p->tok, "REFERENCES")) {
+        parseReferences(p, cols, count);
+    }
+}
+
+/* ALTER TABLE t ADD [CONSTRAINT c] FOREIGN KEY ...; anything else is skipped */
+static void parseAlterTable(struct parser *p, struct tableDef *tables, int tableCount) {
+    struct token name = parseName(p);
+    struct tableDef *def = (name.type == TOK_IDENT) ? findTable(tables, tableCount, name.start, name.length) : NULL;
+    while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, ';') && !tokenIs(&p->tok, "CREATE")
+          && !tokenIs(&p->tok, "ALTER")) {
+        if(def != NULL && tokenIs(&p->tok, "FOREIGN")) {
+            parseForeignKey(p, def);
+        } else {
+            advance(p);
+        }
+    }
+}
+
+/* Matches the declared key against the parsed columns, falling back to ID */
+static void resolveKey(struct parser *p, struct tableDef *def) {
+    const char *wanted = def->key ? def->key : "ID";
+    int i = 0;
+    while(i < def->columnCount) {
+        if(strcasecmp(def->columns[i].name, wanted) == 0) {
+            free(def->key);
+            def->key = countedStrdup(def->columns[i].name);
+            return;
+        }
+        i++;
+    }
+    if(def->columnCount == 0) {
+        printf("%s: WARNING: table %s has no usable columns.\n", p->path, def->name);
+        free(def->key);
+        def->key = countedStrdup("ID");
+        return;
+    }
+    printf("%s: WARNING: no primary key column found for %s, using %s.\n", p->path, def->name, def->columns[0].name);
+    free(def->key);
+    def->key = countedStrdup(def->columns[0].name);
+}
+
+static int parseCreateTable(struct parser *p, struct tableDef *def) {
+    memset(def, 0, sizeof(struct tableDef));
+    
+    if(p->tok.type != TOK_IDENT) {
+        printf("%s:%d: ERROR: expected table name after CREATE TABLE.\n", p->path, p->tok.line);
+        return -1;
+    }
+    /* Only the last part of database.schema.table names the generated classes */
+    struct token name = parseName(p);
+    def->name = countedStrndup(name.start, name.length);
+    def->apiName = countedStrdup(def->name);
+    
+    if(!tokenIsPunct(&p->tok, '(')) {
+        printf("%s:%d: ERROR: expected '(' after CREATE TABLE %s.\n", p->path, p->tok.line, def->name);
+        return -1;
+    }
+    
+    for(;;) {
+        advance(p);
+        if(tokenIs(&p->tok, "CONSTRAINT")) {
+            advance(p);
+            advance(p);
+        }
+        
+        if(tokenIs(&p->tok, "PRIMARY")) {
+            while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, '(')) {
+                advance(p);
+            }
+            advance(p);
+            if(p->tok.type == TOK_IDENT) {
+                free(def->key);
+                def->key = countedStrndup(p->tok.start, p->tok.length);
+                advance(p);
+                if(tokenIsPunct(&p->tok, ',')) {
+                    printf("%s:%d: WARNING: composite key on %s, using %s.\n", p->path, p->tok.line, def->name, def->key);
+                }
+            }
+            while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, ')')) {
+                advance(p);
+            }
+            advance(p);
+        } else if(tokenIs(&p->tok, "FOREIGN")) {
+            parseForeignKey(p, def);
+        } else if(tokenIs(&p->tok, "UNIQUE") || tokenIs(&p->tok, "CHECK") || tokenIs(&p->tok, "INDEX")) {
+            advance(p);
+        } else if(p->tok.type == TOK_IDENT) {
+            struct token colName = p->tok;
+            advance(p);
+            struct token colType = p->tok;
+            advance(p);
+            if(tokenIsPunct(&p->tok, '(')) {
+                /* Length and precision arguments, e.g. varchar(max) or decimal(8,6) */
+                while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, ')')) {
+                    advance(p);
+                }
+                advance(p);
+            }
+            
+            enum fieldType type;
+            if(mapColumnType(&colType, &type) != 0) {
+                printf("%s:%d: WARNING: column %s.%.*s has unsupported type %.*s, skipping.\n", p->path,
+                   colName.line, def->name, colName.length, colName.start, colType.length, colType.start);
+            } else {
+                char *name = countedStrndup(colName.start, colName.length);
+                struct column *col = addColumn(def, name, type);
+                free(name);
+                
+                while(p->tok.type != TOK_END && !tokenIsPunct(&p->tok, ',') && !tokenIsPunct(&p->tok, ')')) {
+                    if(tokenIs(&p->tok, "NOT")) {
+                        advance(p);
+                        if(tokenIs(&p->tok, "NULL")) {
+                            col->notNull = 1;
+                        }
+                    } else if(tokenIs(&p->tok, "PRIMARY")) {
+                        free(def->key);
+                        def->key = countedStrdup(col->name);
+                    } else if(tokenIs(&p->tok, "REFERENCES")) {
+                        parseReferences(p, &col, 1);
+                        continue;
+                    } else if(tokenIsPunct(&p->tok, '(')) {
+                        skipElement(p);
+                        continue;
+                    }
+                    advance(p);
+                }
+            }
+        }
+        
+        skipElement(p);
+        if(p->tok.type == TOK_END) {
+            printf("%s: ERROR: unterminated CREATE TABLE %s.\n", p->path, def->name);
+            return -1;
+        }
+        if(tokenIsPunct(&p->tok, ')')) {
+            advance(p);
+            break;
+        }
+    }
+    
+    resolveKey(p, def);
+    return 0;
+}
+
+int parseSchemaFile(const char *path, struct tableDef **tables, int *tableCount, int *tableCap) {
+    FILE *file_ptr = fopen(path, "rb");
+    if(file_ptr == NULL) {
+        printf("ERROR: Could not open schema file %s.\n", path);
+        return -1;
+    }
+    
+    fseek(file_ptr, 0, SEEK_END);
+    long size = ftell(file_ptr);
+    fseek(file_ptr, 0, SEEK_SET);
+    
+    char *buffer = (char *) malloc(size > 0 ? size : 1);
+    if(buffer == NULL || fread(buffer, 1, size, file_ptr) != (size_t) size) {
+        printf("ERROR: Could not read schema file %s.\n", path);
+        fclose(file_ptr);
+        free(buffer);
+        return -1;
+    }
+    countAllocation(size > 0 ? size : 1);
+    fclose(file_ptr);
+    
+    struct parser p;
+    p.path = path;
+    p.cur = buffer;
+    p.end = buffer + size;
+    p.line = 1;
+    
+    int status = 0;
+    advance(&p);
+    while(p.tok.type != TOK_END) {
+        if(tokenIs(&p.tok, "ALTER")) {
+            advance(&p);
+            if(tokenIs(&p.tok, "TABLE")) {
+                advance(&p);
+                parseAlterTable(&p, *tables, *tableCount);
+            }
+            continue;
+        }
+        if(!tokenIs(&p.tok, "CREATE")) {
+            advance(&p);
+            continue;
+        }
+        advance(&p);
+        if(!tokenIs(&p.tok, "TABLE")) {
+            continue;
+        }
+        advance(&p);
+        
+        struct tableDef def;
+        if(parseCreateTable(&p, &def) != 0) {
+            freeTable(&def);
+            status = -1;
+            break;
+        }
+        
+        int i = 0;
+        while(i < *tableCount && strcasecmp((*tables)[i].name, def.name) != 0) {
+            i++;
+        }
+        if(i < *tableCount) {
+            printf("%s: WARNING: table %s defined more than once, using the later definition.\n", path, def.name);
+            freeTable(&(*tables)[i]);
+            (*tables)[i] = def;
+            continue;
+        }
+        
+        if(*tableCount == *tableCap) {
+            *tableCap = (*tableCap == 0) ? 16 : *tableCap * 2;
+            *tables = (struct tableDef *) countedRealloc(*tables, *tableCap * sizeof(struct tableDef));
+        }
+        (*tables)[(*tableCount)++] = def;
+    }
+    
+    free(buffer);
+    return status;
+}
+
+/*
+ Builds benchTables tables of benchColumns columns each: a long key
+ followed by string, int, long and decimal columns in turn, with every
+ third one indexed. Each run renders and writes the whole schema, as
+ -S would, into a scratch directory under $TMPDIR, and reports on one
+ JSON line written to results.
+ */
+int runBenchmark(int jobCount, FILE *results) {
+    static const enum fieldType types[] = { FIELD_STRING, FIELD_INT, FIELD_LONG, FIELD_DECIMAL };
+    
+    if(schemaIndex > 0 || annotationCount > 0 || relationCount > 0 || cacheCount > 0) {
+        printf("WARNING: --bench makes up its own schema, so -S, -x, -f, -r and -e are ignored.\n");
+    }
+    
+    __atomic_store_n(&allocations, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&allocatedBytes, 0, __ATOMIC_RELAXED);
+    struct tableDef *tables = (struct tableDef *) calloc(benchTables, sizeof(struct tableDef));
+    if(tables == NULL) {
+        printf("ERROR: Out of memory.\n");
+        exit(1);
+    }
+    countAllocation(benchTables * sizeof(struct tableDef));
+    char name[MAX_FILE_STRING];
+    int t = 0;
+    while(t < benchTables) {
+        snprintf(name, sizeof(name), "Bench%d", t);
+        tables[t].name = countedStrdup(name);
+        tables[t].apiName = countedStrdup(name);
+        tables[t].key = countedStrdup("ID");
+        addColumn(&tables[t], "ID", FIELD_LONG)->notNull = 1;
+        int c = 1;
+        while(c < benchColumns) {
+            snprintf(name, sizeof(name), "Field%d", c);
+            addColumn(&tables[t], name, types[(c - 1) % 4])->indexed = (c % 3 == 0);
+            c++;
+        }
+        t++;
+    }
+    
+    uint64_t schemaAllocations = allocations;
+    uint64_t schemaBytes = allocatedBytes;
+    
+    const char *tempDir = getenv("TMPDIR");
+    if(joinStrings(benchDir, sizeof(benchDir), (tempDir != NULL && tempDir[0] != '\0') ? tempDir : "/tmp",
+                   "/ContextGenerator.XXXXXX", NULL) != 0) {
+        freeTables(tables, benchTables);
+        return 1;
+    }
+    if(mkdtemp(benchDir) == NULL) {
+        printf("ERROR: Could not create %s: %s\n", benchDir, strerror(errno));
+        freeTables(tables, benchTables);
+        return 1;
+    }
+    
+    int status = 0;
+    int run = 0;
+    while(run < benchRuns && status == 0) {
+        __atomic_store_n(&allocations, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&allocatedBytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&renderedFiles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&renderedBytes, 0, __ATOMIC_RELAXED);
+        
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = generateTables(tables, benchTables, 1, jobCount);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if(status != 0) {
+            break;
+        }
+        
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double seconds = (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(results, "{\"tables\":%d,\"columns\":%d,\"jobs\":%d,\"run\":%d,\"seconds\":%.6f,"
+                "\"files\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"allocations\":%" PRIu64 ","
+                "\"allocatedBytes\":%" PRIu64 ",\"schemaAllocations\":%" PRIu64 ",\"schemaBytes\":%" PRIu64 ","
+                "\"maxRssKb\":%ld}\n",
+                benchTables, benchColumns, jobCount, run + 1, seconds, renderedFiles, renderedBytes,
+                allocations, allocatedBytes, schemaAllocations, schemaBytes, usage.ru_maxrss);
+        fflush(results);
+        run++;
+    }
+    
+    removeTree(benchDir);
+    freeTables(tables, benchTables);
+    return status;
+}
+
+void freeTables(struct tableDef *tables, int tableCount) {
+    int i = 0;
+    while(i < tableCount) {
+        freeTable(&tables[i]);
+        i++;
+    }
+    free(tables);
 }